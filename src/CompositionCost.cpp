@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <shared_mutex>
+#include <pxr/base/work/loops.h>
+#include <pxr/usd/pcp/primIndex.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/usd/primRange.h>
+#include "CompositionCost.h"
+#include "Commands.h"
+
+/// Number of prims traversed while holding the stage edit lock
+static constexpr size_t ScanBatchSize = 256;
+
+PrimCompositionCost ComputePrimCompositionCost(const UsdPrim &prim) {
+    PrimCompositionCost cost;
+    const PcpPrimIndex &primIndex = prim.GetPrimIndex();
+    if (!primIndex.IsValid()) {
+        return cost;
+    }
+    const PcpNodeRange nodes = primIndex.GetNodeRange();
+    for (auto node = nodes.first; node != nodes.second; ++node) {
+        cost.numNodes++;
+        cost.arcTypes |= 1u << (*node).GetArcType();
+    }
+    // The prim stack is ordered from the strongest to the weakest opinion
+    const SdfPrimSpecHandleVector primStack = prim.GetPrimStack();
+    cost.numSpecs = static_cast<uint32_t>(primStack.size());
+    std::vector<SdfLayerHandle> layers;
+    for (const auto &spec : primStack) {
+        const SdfLayerHandle layer = spec->GetLayer();
+        if (std::find(layers.begin(), layers.end(), layer) == layers.end()) {
+            layers.push_back(layer);
+        }
+    }
+    cost.numLayers = static_cast<uint32_t>(layers.size());
+    if (!primStack.empty()) {
+        cost.strongestLayer = primStack.front()->GetLayer();
+    }
+    cost.isValid = true;
+    return cost;
+}
+
+std::string GetArcTypesString(uint32_t arcTypes) {
+    // Same order as PcpArcType
+    static const char arcLetters[] = {'/', 'I', 'V', 'L', 'R', 'P', 'S'};
+    std::string arcs;
+    for (uint32_t arcType = PcpArcTypeInherit; arcType < PcpNumArcTypes && arcType < sizeof(arcLetters); ++arcType) {
+        if (arcTypes & (1u << arcType)) {
+            arcs += arcLetters[arcType];
+        }
+    }
+    return arcs;
+}
+
+CompositionCostScan::~CompositionCostScan() { Cancel(); }
+
+void CompositionCostScan::Start(const UsdStageRefPtr &stage, SdfPathVector roots) {
+    Cancel();
+    _interrupted = false;
+    _roots = std::move(roots);
+    _finishedRoots.assign(_roots.size(), false);
+    if (!stage || _roots.empty()) {
+        return;
+    }
+    _cancelled = false;
+    _resynced = false;
+    _running = true;
+    // The notices are sent by the ui thread while it holds the stage edit lock
+    _noticeKey = TfNotice::Register(TfCreateWeakPtr(this), &CompositionCostScan::OnObjectsChanged, UsdStageWeakPtr(stage));
+    _thread = std::thread(&CompositionCostScan::Scan, this, stage);
+}
+
+void CompositionCostScan::Cancel() {
+    _cancelled = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    TfNotice::Revoke(_noticeKey);
+    _running = false;
+    std::lock_guard<std::mutex> lock(_resultsMutex);
+    _results.clear();
+}
+
+void CompositionCostScan::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+    for (const auto &path : notice.GetResyncedPaths()) {
+        if (!path.IsPropertyPath()) {
+            _resynced = true;
+            return;
+        }
+    }
+}
+
+SdfPathVector CompositionCostScan::GetUnfinishedRoots() const {
+    SdfPathVector roots;
+    if (!_running) {
+        for (size_t rootIndex = 0; rootIndex < _roots.size(); ++rootIndex) {
+            if (!_finishedRoots[rootIndex]) {
+                roots.push_back(_roots[rootIndex]);
+            }
+        }
+    }
+    return roots;
+}
+
+bool CompositionCostScan::FetchResults(std::vector<Result> &results) {
+    std::lock_guard<std::mutex> lock(_resultsMutex);
+    if (_results.empty()) {
+        return false;
+    }
+    results.insert(results.end(), std::make_move_iterator(_results.begin()), std::make_move_iterator(_results.end()));
+    _results.clear();
+    return true;
+}
+
+void CompositionCostScan::PushResults(std::vector<Result> &results) {
+    if (!results.empty()) {
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        _results.insert(_results.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+        results.clear();
+    }
+}
+
+void CompositionCostScan::Scan(UsdStageRefPtr stage) {
+    const auto stopScanning = [&]() {
+        if (_resynced) {
+            _interrupted = true;
+        }
+        return _cancelled || _interrupted;
+    };
+
+    // The roots are scanned in parallel, each task only writes the finished flag of its root
+    std::vector<size_t> rootIndices(_roots.size());
+    for (size_t rootIndex = 0; rootIndex < rootIndices.size(); ++rootIndex) {
+        rootIndices[rootIndex] = rootIndex;
+    }
+    WorkParallelForEach(rootIndices.begin(), rootIndices.end(), [&](size_t rootIndex) {
+        std::shared_lock<std::shared_timed_mutex> batchLock(GetStageEditMutex(), std::defer_lock);
+        if (!LockStageEditsShared(batchLock, _cancelled) || stopScanning()) {
+            return;
+        }
+        const UsdPrim root = stage->GetPrimAtPath(_roots[rootIndex]);
+        if (!root) {
+            _finishedRoots[rootIndex] = true;
+            return;
+        }
+        std::vector<Result> results;
+        size_t batchCount = 0;
+        for (const UsdPrim &prim : UsdPrimRange(root, UsdPrimAllPrimsPredicate)) {
+            results.emplace_back(prim.GetPath(), ComputePrimCompositionCost(prim));
+            if (++batchCount == ScanBatchSize) {
+                batchCount = 0;
+                PushResults(results);
+                // Give a pending edit the chance to take the lock, the results are pushed before.
+                // The traversal can't continue after a resync
+                batchLock.unlock();
+                if (!LockStageEditsShared(batchLock, _cancelled) || stopScanning()) {
+                    return;
+                }
+            }
+        }
+        PushResults(results);
+        _finishedRoots[rootIndex] = true;
+    });
+    _running = false;
+}
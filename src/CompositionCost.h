@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/usd/notice.h>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// Composition cost of a prim, read from its PcpPrimIndex
+struct PrimCompositionCost {
+    uint32_t numNodes = 0;     // Nodes of the prim index
+    uint32_t numSpecs = 0;     // Opinions contributing to the prim
+    uint32_t numLayers = 0;    // Layers with an opinion on the prim
+    uint32_t arcTypes = 0;     // Bit mask of the PcpArcType of the nodes
+    SdfLayerHandle strongestLayer;
+    bool isValid = false;
+};
+
+PrimCompositionCost ComputePrimCompositionCost(const UsdPrim &prim);
+
+/// Short name of the arcs, one letter per arc type
+std::string GetArcTypesString(uint32_t arcTypes);
+
+///
+/// Computes the composition cost of the prims of subtrees of a stage, in the background.
+/// The subtrees are traversed in parallel while holding the stage edit lock shared, by batches, so the stage edits
+/// happen between the batches. The traversal continues after the edits which don't change the hierarchy, a resync
+/// stops the scan and the owner has to scan again the unfinished roots.
+/// All the costs computed before an edit are available to fetch when the edit notices are sent.
+///
+class CompositionCostScan final : public TfWeakBase {
+  public:
+    using Result = std::pair<SdfPath, PrimCompositionCost>;
+
+    CompositionCostScan() = default;
+    ~CompositionCostScan();
+
+    // Delete copy
+    CompositionCostScan(const CompositionCostScan &) = delete;
+    CompositionCostScan &operator=(const CompositionCostScan &) = delete;
+
+    /// Start scanning the subtrees at roots, cancelling the running scan
+    void Start(const UsdStageRefPtr &stage, SdfPathVector roots);
+
+    /// Stop the scan, the results not fetched are dropped
+    void Cancel();
+
+    /// Append the costs computed since the last fetch to results. Returns false if there was none
+    bool FetchResults(std::vector<Result> &results);
+
+    bool IsRunning() const { return _running; }
+
+    /// The scan was stopped by a resync before the end of the traversal
+    bool WasInterrupted() const { return _interrupted; }
+
+    /// Roots of the last scan which were not entirely traversed
+    SdfPathVector GetUnfinishedRoots() const;
+
+  private:
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice);
+    void Scan(UsdStageRefPtr stage);
+    void PushResults(std::vector<Result> &results);
+
+    SdfPathVector _roots;
+    std::vector<char> _finishedRoots; // One flag per root, written by the task scanning the root
+    std::thread _thread;
+    TfNotice::Key _noticeKey;
+    std::atomic<bool> _cancelled{false};
+    std::atomic<bool> _resynced{false};
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _interrupted{false};
+
+    std::mutex _resultsMutex;
+    std::vector<Result> _results; // Computed and not fetched yet
+};
@@ -28,6 +28,7 @@ constexpr float TimeBeforeTooltip = 2.f; // 2 seconds
 #define MiniButtonUnauthoredColor {0.6, 0.6, 0.6, 1.0}
 #define TransparentColor {0.0, 0.0, 0.0, 0.0}
 #define PrimInactiveColor {0.7, 0.4, 0.4, 1.0}
+#define PrimHasSelectedDescendantColor {0.9, 0.7, 0.2, 1.0}
 
 
 /// Decimal Precision shown in the floating point values UI
@@ -0,0 +1,292 @@
+#include <iterator>
+#include <shared_mutex>
+#include <pxr/base/work/loops.h>
+#include <pxr/usd/usd/primFlags.h>
+#include <pxr/usd/usd/primRange.h>
+#include <pxr/usd/usdGeom/gprim.h>
+#include "DescendantCounts.h"
+#include "Commands.h"
+
+/// The subtrees under the first levels are counted in parallel, the prims of the first levels are counted last
+static constexpr int ParallelCountDepth = 2;
+
+/// Number of prims traversed while holding the stage edit lock
+static constexpr size_t CountBatchSize = 256;
+
+/// Above this number of resynced prims, the stage is counted again in the background instead of the resynced subtrees
+static constexpr size_t MaxUpdatedPrims = 10000;
+
+PrimCounts &PrimCounts::operator+=(const PrimCounts &other) {
+    total += other.total;
+    loaded += other.loaded;
+    active += other.active;
+    gprims += other.gprims;
+    return *this;
+}
+
+PrimCounts &PrimCounts::operator-=(const PrimCounts &other) {
+    total -= other.total;
+    loaded -= other.loaded;
+    active -= other.active;
+    gprims -= other.gprims;
+    return *this;
+}
+
+/// Same traversal as the outliner, the instance proxies are counted under their instances
+static Usd_PrimFlagsPredicate GetCountedPrimsPredicate() { return UsdTraverseInstanceProxies(UsdPrimAllPrimsPredicate); }
+
+static PrimCounts GetOwnCounts(const UsdPrim &prim) {
+    PrimCounts counts;
+    counts.total = 1;
+    counts.loaded = prim.IsLoaded() ? 1 : 0;
+    counts.active = prim.IsActive() ? 1 : 0;
+    counts.gprims = prim.IsA<UsdGeomGprim>() ? 1 : 0;
+    return counts;
+}
+
+size_t CountDescendants(const UsdPrim &prim, size_t maxCount) {
+    size_t count = 0;
+    UsdPrimRange range(prim, GetCountedPrimsPredicate());
+    for (auto it = std::next(range.begin()); it != range.end() && count < maxCount; ++it) {
+        count++;
+    }
+    return count;
+}
+
+/// The counted prims are appended in post order. The traversal stops when continueCounting returns false
+template <typename ContinueFuncT>
+PrimCounts DescendantCounter::CountSubtree(const UsdPrim &prim, std::vector<CountedPrim> &countedPrims,
+                                           const ContinueFuncT &continueCounting) {
+    std::vector<Entry> openEntries; // Entries of the ancestors of the current prim
+    PrimCounts subtree;
+    const UsdPrimRange range = UsdPrimRange::PreAndPostVisit(prim, GetCountedPrimsPredicate());
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        if (!it.IsPostVisit()) {
+            Entry entry;
+            entry.own = GetOwnCounts(*it);
+            entry.subtree = entry.own;
+            openEntries.push_back(entry);
+        } else {
+            subtree = openEntries.back().subtree;
+            countedPrims.emplace_back(it->GetPath(), openEntries.back());
+            openEntries.pop_back();
+            if (!openEntries.empty()) {
+                openEntries.back().subtree += subtree;
+            }
+        }
+        if (!continueCounting()) {
+            break;
+        }
+    }
+    return subtree;
+}
+
+void DescendantCounter::Insert(std::vector<CountedPrim> &countedPrims) {
+    for (auto &countedPrim : countedPrims) {
+        _counts[countedPrim.first] = countedPrim.second;
+    }
+}
+
+DescendantCounter::~DescendantCounter() { Cancel(); }
+
+void DescendantCounter::Start(const UsdStageRefPtr &stage) {
+    Clear();
+    if (!stage) {
+        return;
+    }
+    _cancelled = false;
+    _resynced = false;
+    _interrupted = false;
+    _running = true;
+    // The notices are sent by the ui thread while it holds the stage edit lock
+    _noticeKey = TfNotice::Register(TfCreateWeakPtr(this), &DescendantCounter::OnObjectsChanged, UsdStageWeakPtr(stage));
+    _thread = std::thread(&DescendantCounter::Count, this, stage);
+}
+
+void DescendantCounter::Cancel() {
+    _cancelled = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    TfNotice::Revoke(_noticeKey);
+    _running = false;
+    _results.clear();
+}
+
+void DescendantCounter::Clear() {
+    Cancel();
+    _counts.clear();
+    _isComputed = false;
+}
+
+void DescendantCounter::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+    for (const auto &path : notice.GetResyncedPaths()) {
+        if (!path.IsPropertyPath()) {
+            _resynced = true;
+            return;
+        }
+    }
+}
+
+bool DescendantCounter::FetchResults() {
+    if (_isComputed || _running || !_thread.joinable()) {
+        return false;
+    }
+    _thread.join();
+    TfNotice::Revoke(_noticeKey);
+    // A resync after the end of the count is not in the results
+    if (_resynced) {
+        _interrupted = true;
+    }
+    if (!_interrupted) {
+        Insert(_results);
+        _isComputed = true;
+    }
+    _results.clear();
+    return _isComputed;
+}
+
+void DescendantCounter::Count(UsdStageRefPtr stage) {
+    std::shared_lock<std::shared_timed_mutex> batchLock(GetStageEditMutex(), std::defer_lock);
+    size_t batchCount = 0;
+    // Returns false if the count must stop. The lock is released between the batches so the edits can happen
+    const auto continueCounting = [&](std::shared_lock<std::shared_timed_mutex> &lock, size_t &count) {
+        if (++count == CountBatchSize) {
+            count = 0;
+            lock.unlock();
+            if (!LockStageEditsShared(lock, _cancelled)) {
+                return false;
+            }
+        }
+        if (_resynced) {
+            _interrupted = true;
+        }
+        return !_cancelled && !_interrupted;
+    };
+
+    // The prims of the first levels, in pre order, with the index of their parent
+    struct TopPrim {
+        UsdPrim prim;
+        size_t parent;
+        Entry entry;
+    };
+    std::vector<TopPrim> topPrims;
+    std::vector<std::pair<UsdPrim, size_t>> roots; // Subtrees counted in parallel, with the index of their parent
+    if (!LockStageEditsShared(batchLock, _cancelled)) {
+        _running = false;
+        return;
+    }
+    topPrims.push_back(TopPrim{stage->GetPseudoRoot(), 0, Entry()});
+    for (size_t topIndex = 0; topIndex < topPrims.size(); ++topIndex) {
+        const int depth = static_cast<int>(topPrims[topIndex].prim.GetPath().GetPathElementCount());
+        topPrims[topIndex].entry.own = GetOwnCounts(topPrims[topIndex].prim);
+        topPrims[topIndex].entry.subtree = topPrims[topIndex].entry.own;
+        for (const auto &child : topPrims[topIndex].prim.GetFilteredChildren(GetCountedPrimsPredicate())) {
+            if (depth + 1 < ParallelCountDepth) {
+                topPrims.push_back(TopPrim{child, topIndex, Entry()});
+            } else {
+                roots.emplace_back(child, topIndex);
+            }
+            if (!continueCounting(batchLock, batchCount)) {
+                _running = false;
+                return;
+            }
+        }
+    }
+    batchLock.unlock();
+
+    // Each task counts its subtree by batches and fills its own vector
+    std::vector<std::vector<CountedPrim>> rootCountedPrims(roots.size());
+    std::vector<PrimCounts> rootCounts(roots.size());
+    WorkParallelForN(roots.size(), [&](size_t begin, size_t end) {
+        std::shared_lock<std::shared_timed_mutex> taskLock(GetStageEditMutex(), std::defer_lock);
+        if (!LockStageEditsShared(taskLock, _cancelled)) {
+            return;
+        }
+        size_t taskCount = 0;
+        bool mustStop = false;
+        // The traversal can't continue after a resync
+        const auto continueTask = [&]() {
+            mustStop = !continueCounting(taskLock, taskCount);
+            return !mustStop;
+        };
+        for (size_t rootIndex = begin; rootIndex < end && !mustStop; ++rootIndex) {
+            rootCounts[rootIndex] = CountSubtree(roots[rootIndex].first, rootCountedPrims[rootIndex], continueTask);
+        }
+    });
+    if (_cancelled || _interrupted) {
+        _running = false;
+        return;
+    }
+
+    // The first levels are summed bottom up, a top prim comes after its parent
+    for (size_t rootIndex = 0; rootIndex < roots.size(); ++rootIndex) {
+        topPrims[roots[rootIndex].second].entry.subtree += rootCounts[rootIndex];
+    }
+    for (size_t topIndex = topPrims.size() - 1; topIndex > 0; --topIndex) {
+        topPrims[topPrims[topIndex].parent].entry.subtree += topPrims[topIndex].entry.subtree;
+    }
+    for (auto &countedPrims : rootCountedPrims) {
+        _results.insert(_results.end(), std::make_move_iterator(countedPrims.begin()), std::make_move_iterator(countedPrims.end()));
+    }
+    for (const auto &topPrim : topPrims) {
+        _results.emplace_back(topPrim.prim.GetPath(), topPrim.entry);
+    }
+    _running = false;
+}
+
+void DescendantCounter::Update(const UsdStageRefPtr &stage, SdfPathVector resyncedPaths) {
+    if (!_isComputed || resyncedPaths.empty()) {
+        return;
+    }
+    SdfPath::RemoveDescendentPaths(&resyncedPaths);
+    size_t numResyncedPrims = 0;
+    for (const auto &path : resyncedPaths) {
+        // A prototype is counted under all its instances, it is simpler to count everything again
+        if (path.IsAbsoluteRootPath() || UsdPrim::IsPathInPrototype(path)) {
+            Start(stage);
+            return;
+        }
+        auto entry = _counts.find(path);
+        if (entry != _counts.end()) {
+            numResyncedPrims += entry->second.subtree.total;
+        }
+    }
+    // The size of the subtrees before the resync gives an idea of the cost of counting them again
+    if (numResyncedPrims > MaxUpdatedPrims) {
+        Start(stage);
+        return;
+    }
+    for (const auto &path : resyncedPaths) {
+        PrimCounts oldCounts;
+        auto oldEntry = _counts.find(path);
+        if (oldEntry != _counts.end()) {
+            oldCounts = oldEntry->second.subtree;
+            _counts.erase(oldEntry);
+        }
+        PrimCounts newCounts;
+        const UsdPrim prim = stage->GetPrimAtPath(path);
+        if (prim && _counts.find(path.GetParentPath()) != _counts.end()) {
+            std::vector<CountedPrim> countedPrims;
+            newCounts = CountSubtree(prim, countedPrims, []() { return true; });
+            Insert(countedPrims);
+        }
+        for (SdfPath ancestor = path.GetParentPath(); !ancestor.IsEmpty(); ancestor = ancestor.GetParentPath()) {
+            auto ancestorEntry = _counts.find(ancestor);
+            if (ancestorEntry != _counts.end()) {
+                ancestorEntry->second.subtree -= oldCounts;
+                ancestorEntry->second.subtree += newCounts;
+            }
+        }
+    }
+}
+
+bool DescendantCounter::GetDescendantCounts(const SdfPath &path, PrimCounts &counts) const {
+    const auto entry = _counts.find(path);
+    if (entry == _counts.end()) {
+        return false;
+    }
+    counts = entry->second.subtree;
+    counts -= entry->second.own;
+    return true;
+}
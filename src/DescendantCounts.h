@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/sdf/pathTable.h>
+#include <pxr/usd/usd/notice.h>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// Number of prims of a set of prims
+struct PrimCounts {
+    size_t total = 0;
+    size_t loaded = 0;
+    size_t active = 0;
+    size_t gprims = 0;
+
+    PrimCounts &operator+=(const PrimCounts &other);
+    PrimCounts &operator-=(const PrimCounts &other);
+};
+
+/// Number of descendants of the prim, including the instance proxies. The traversal stops at maxCount
+size_t CountDescendants(const UsdPrim &prim, size_t maxCount);
+
+///
+/// Descendant counts of all the prims of a stage, including the instance proxies like the outliner.
+/// The whole stage is counted in the background, the subtrees under the first levels of the hierarchy in parallel,
+/// while holding the stage edit lock shared, by batches. A resync stops the count and the owner has to start it
+/// again. Once the counts are fetched, only the resynced subtrees are counted again and the difference is applied
+/// to their ancestors.
+///
+class DescendantCounter final : public TfWeakBase {
+  public:
+    DescendantCounter() = default;
+    ~DescendantCounter();
+
+    // Delete copy
+    DescendantCounter(const DescendantCounter &) = delete;
+    DescendantCounter &operator=(const DescendantCounter &) = delete;
+
+    /// Start counting all the prims of the stage in the background, the current counts are dropped
+    void Start(const UsdStageRefPtr &stage);
+
+    /// Stop the count and drop the counts
+    void Clear();
+
+    bool IsRunning() const { return _running; }
+
+    /// The count was stopped by a resync before the end of the traversal
+    bool WasInterrupted() const { return _interrupted; }
+
+    /// Take the counts of a finished background count. Returns true if the counts became available
+    bool FetchResults();
+
+    /// Count again the resynced subtrees and update the counts of their ancestors. The whole stage is counted again
+    /// in the background when the resynced subtrees are big
+    void Update(const UsdStageRefPtr &stage, SdfPathVector resyncedPaths);
+
+    bool IsComputed() const { return _isComputed; }
+
+    /// Counts of the descendants of the prim at path, the prim excluded. Returns false if it wasn't counted
+    bool GetDescendantCounts(const SdfPath &path, PrimCounts &counts) const;
+
+  private:
+    struct Entry {
+        PrimCounts subtree; // The prim and its descendants
+        PrimCounts own;
+    };
+    using CountedPrim = std::pair<SdfPath, Entry>;
+
+    template <typename ContinueFuncT>
+    static PrimCounts CountSubtree(const UsdPrim &prim, std::vector<CountedPrim> &countedPrims,
+                                   const ContinueFuncT &continueCounting);
+    void Insert(std::vector<CountedPrim> &countedPrims);
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice);
+    void Count(UsdStageRefPtr stage);
+    void Cancel();
+
+    SdfPathTable<Entry> _counts;
+    bool _isComputed = false;
+
+    // Background count
+    std::thread _thread;
+    TfNotice::Key _noticeKey;
+    std::atomic<bool> _cancelled{false};
+    std::atomic<bool> _resynced{false};
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _interrupted{false};
+    std::vector<CountedPrim> _results; // Written by the count thread before it stops running
+};
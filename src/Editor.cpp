@@ -21,8 +21,12 @@
 #include "Timeline.h"
 #include "ContentBrowser.h"
 #include "PrimSpecEditor.h"
+#include "LoadRulesEditor.h"
+#include "LayerDiffView.h"
 #include "Constants.h"
 #include "Commands.h"
+#include "EditJournal.h"
+#include "UndoLayerStateDelegate.h"
 
 // Get usd known file format extensions and returns then prefixed with a dot and in a vector
 static const std::vector<std::string> GetUsdValidExtensions() {
@@ -71,18 +75,27 @@ struct OpenUsdFileModalDialog : public ModalDialog {
     ~OpenUsdFileModalDialog() override {}
     void Draw() override {
         DrawFileBrowser();
+        auto filePath = GetFileBrowserFilePath();
 
         if (FilePathExists()) {
             ImGui::Checkbox("Open as stage", &openAsStage);
+            if (openAsStage) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Load payloads", &loadPayloads);
+                DrawPopulationMask(filePath);
+            }
         } else {
             ImGui::Text("Not found: ");
         }
-        auto filePath = GetFileBrowserFilePath();
         ImGui::Text("%s", filePath.c_str());
         DrawOkCancelModal([&]() {
             if (!filePath.empty() && FilePathExists()) {
                 if (openAsStage) {
-                    editor.ImportStage(filePath);
+                    // An empty mask means the whole stage
+                    const UsdStagePopulationMask mask = maskPaths.empty()
+                                                            ? UsdStagePopulationMask::All()
+                                                            : UsdStagePopulationMask(maskPaths.begin(), maskPaths.end());
+                    editor.ImportStage(filePath, loadPayloads ? UsdStage::LoadAll : UsdStage::LoadNone, mask);
                 } else {
                     editor.ImportLayer(filePath);
                 }
@@ -90,9 +103,79 @@ struct OpenUsdFileModalDialog : public ModalDialog {
         });
     }
 
+    /// Prim specs of the scanned root layer, the children are only read when their parent is unfolded
+    void DrawScannedPrimSpecs(const SdfPrimSpecHandle &parent) {
+        for (const auto &child : parent->GetNameChildren()) {
+            ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow;
+            if (child->GetNameChildren().empty()) {
+                flags |= ImGuiTreeNodeFlags_Leaf;
+            }
+            const SdfPath &path = child->GetPath();
+            const bool isMasked = maskPaths.count(path) != 0;
+            if (isMasked) {
+                flags |= ImGuiTreeNodeFlags_Selected;
+            }
+            const bool unfolded = ImGui::TreeNodeEx(child->GetName().c_str(), flags);
+            if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen()) {
+                if (isMasked) {
+                    maskPaths.erase(path);
+                } else {
+                    maskPaths.insert(path);
+                }
+            }
+            if (unfolded) {
+                DrawScannedPrimSpecs(child);
+                ImGui::TreePop();
+            }
+        }
+    }
+
+    /// The population mask is entered as paths or picked in the prim hierarchy of the root layer.
+    /// Only the root layer is read for the scan, nothing is composed, and it is kept open for the stage.
+    void DrawPopulationMask(const std::string &filePath) {
+        ImGui::InputTextWithHint("##MaskPath", "/Path/To/Prim", &maskPathInput);
+        ImGui::SameLine();
+        if (ImGui::Button("Add to mask") && SdfPath::IsValidPathString(maskPathInput)) {
+            const SdfPath path(maskPathInput);
+            if (path.IsAbsolutePath() && path.IsAbsoluteRootOrPrimPath()) {
+                maskPaths.insert(path);
+                maskPathInput.clear();
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Scan root layer")) {
+            scannedLayer = SdfLayer::FindOrOpen(filePath);
+            scannedFilePath = filePath;
+        }
+        if (scannedLayer && scannedFilePath == filePath) {
+            ImGui::BeginChild("##ScannedPrimSpecs", ImVec2(0, ImGui::GetFontSize() * 12), true);
+            DrawScannedPrimSpecs(scannedLayer->GetPseudoRoot());
+            ImGui::EndChild();
+        }
+        if (maskPaths.empty()) {
+            ImGui::Text("No population mask, the whole stage is composed");
+        }
+        SdfPath removedPath;
+        for (const auto &path : maskPaths) {
+            ImGui::PushID(path.GetText());
+            if (ImGui::SmallButton(ICON_DELETE)) {
+                removedPath = path;
+            }
+            ImGui::PopID();
+            ImGui::SameLine();
+            ImGui::Text("%s", path.GetText());
+        }
+        maskPaths.erase(removedPath);
+    }
+
     const char *DialogId() const override { return "Open layer"; }
     Editor &editor;
     bool openAsStage = true;
+    bool loadPayloads = true;
+    std::set<SdfPath> maskPaths;
+    std::string maskPathInput;
+    SdfLayerRefPtr scannedLayer;
+    std::string scannedFilePath;
 };
 
 struct SaveLayerAs : public ModalDialog {
@@ -119,6 +202,48 @@ struct SaveLayerAs : public ModalDialog {
     Editor &editor;
 };
 
+/// Modal dialog proposing to replay the edits of a session which didn't exit cleanly
+struct RecoverEditsModalDialog : public ModalDialog {
+
+    RecoverEditsModalDialog(Editor &editor, const std::string &journalPath) : editor(editor), journalPath(journalPath){};
+    // The edits are discarded when the dialog is cancelled
+    ~RecoverEditsModalDialog() override { RemoveCrashedEditJournal(journalPath); }
+    void Draw() override {
+        if (!recovered) {
+            ImGui::Text("A previous session didn't exit cleanly and left unsaved edits.");
+            ImGui::Text("Replay them on the layers ? Cancel discards them.");
+            if (ImGui::Button("Cancel")) {
+                CloseModal();
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Ok")) {
+                report = editor.RecoverEdits(journalPath);
+                recovered = true;
+            }
+            return;
+        }
+        // The result stays displayed until the dialog is closed
+        ImGui::Text("Recovered %zu commands and %zu operations, %zu operations skipped.", report.numCommands,
+                    report.numOperations, report.numSkippedOperations);
+        if (!report.skipped.empty()) {
+            ImGui::Text("Edits not recovered on:");
+            ImGui::BeginChild("##SkippedLayers", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 8), true);
+            for (const auto &skipped : report.skipped) {
+                ImGui::BulletText("%s", skipped.c_str());
+            }
+            ImGui::EndChild();
+        }
+        if (ImGui::Button("Close")) {
+            CloseModal();
+        }
+    }
+
+    const char *DialogId() const override { return "Recover edits"; }
+    Editor &editor;
+    std::string journalPath;
+    bool recovered = false;
+    EditJournalReplayReport report;
+};
 
 static void BeginBackgoundDock() {
     // Setup dockspace using experimental imgui branch
@@ -168,11 +293,21 @@ void Editor::DropCallback(GLFWwindow *window, int count, const char **paths) {
 }
 
 
-Editor::Editor() : _viewport(UsdStageRefPtr(), _selection) {
+Editor::Editor() : _viewport(UsdStageRefPtr()) {
     ExecuteAfterDraw<EditorSetDataPointer>(this); // This is specialized to execute here, not after the draw
+
+    // A journal left on disk without its lock means a previous session crashed
+    const std::string journalDirectory = GetEditJournalDirectory();
+    const std::string crashedJournal = ClaimCrashedEditJournal(journalDirectory);
+    if (!crashedJournal.empty()) {
+        DrawModalDialog<RecoverEditsModalDialog>(*this, crashedJournal);
+    }
+    StartEditJournal(journalDirectory);
 }
 
-Editor::~Editor(){}
+Editor::~Editor() {
+    StopEditJournal(true); // Clean exit, the journal is not needed anymore
+}
 
 void Editor::SetCurrentStage(UsdStageCache::Id current) {
     SetCurrentStage(_stageCache.Find(current));
@@ -180,6 +315,8 @@ void Editor::SetCurrentStage(UsdStageCache::Id current) {
 
 void Editor::SetCurrentStage(UsdStageRefPtr stage) {
     _currentStage = stage;
+    // Layers used by the stage keep the same undo/redo delegate
+    InstallUndoRedoDelegates(_currentStage);
     // NOTE: We set the default layer to the current stage root
     // this might have side effects
     if (!GetCurrentLayer() && _currentStage) {
@@ -187,6 +324,7 @@ void Editor::SetCurrentStage(UsdStageRefPtr stage) {
     }
     // TODO multiple viewport management
     _viewport.SetCurrentStage(stage);
+    _viewport.ReleaseStageStates(_stageCache);
 }
 
 void Editor::SetCurrentLayer(SdfLayerRefPtr layer) {
@@ -234,6 +372,7 @@ void Editor::UseLayer(SdfLayerRefPtr layer) {
     if (layer) {
         if (_layers.find(layer) == _layers.end()) {
             _layers.emplace(layer);
+            InstallUndoRedoDelegate(layer);
         }
         SetCurrentLayer(layer);
         _showContentBrowser = true;
@@ -253,8 +392,12 @@ void Editor::ImportLayer(const std::string &path) {
 }
 
 //
-void Editor::ImportStage(const std::string &path) {
-    auto newStage = UsdStage::Open(path);
+void Editor::ImportStage(const std::string &path, UsdStage::InitialLoadSet loadSet,
+                         const UsdStagePopulationMask &populationMask) {
+    // A mask including the whole stage is the same as no mask
+    auto newStage = populationMask.IncludesSubtree(SdfPath::AbsoluteRootPath())
+                        ? UsdStage::Open(path, loadSet)
+                        : UsdStage::OpenMasked(path, populationMask, loadSet);
     if (newStage) {
         _stageCache.Insert(newStage);
         SetCurrentStage(newStage);
@@ -272,6 +415,15 @@ void Editor::SaveCurrentLayerAs(const std::string &path) {
     }
 }
 
+EditJournalReplayReport Editor::RecoverEdits(const std::string &journalPath) {
+    const EditJournalReplayReport report = ReplayEditJournal(journalPath, ExecuteAndRecord);
+    for (const auto &layer : report.layers) {
+        UseLayer(layer);
+    }
+    RemoveCrashedEditJournal(journalPath);
+    return report;
+}
+
 void Editor::CreateStage(const std::string &path) {
     auto usdaFormat = SdfFileFormat::FindByExtension("usda");
     auto layer = SdfLayer::New(usdaFormat, path);
@@ -345,12 +497,40 @@ void Editor::DrawMainMenuBar() {
             ImGui::MenuItem("Layer editor", nullptr, &_showLayerEditor);
             ImGui::MenuItem("Viewport", nullptr, &_showViewport);
             ImGui::MenuItem("SdfPrim editor", nullptr, &_showPrimSpecEditor);
+            ImGui::MenuItem("Load rules", nullptr, &_showLoadRules);
+            ImGui::MenuItem("Layer diff", nullptr, &_showLayerDiff);
             ImGui::EndMenu();
         }
         ImGui::EndMenuBar();
     }
 }
 
+/// Progress of the payloads loaded in the background, each request can be cancelled
+static void DrawPayloadLoaderProgress(PayloadLoader &loader) {
+    for (const auto &progress : loader.GetProgress()) {
+        ImGui::PushID(progress.path.GetString().c_str());
+        if (ImGui::SmallButton(ICON_FA_TIMES)) {
+            loader.Cancel(progress.stage, progress.path);
+        }
+        ImGui::SameLine();
+        if (!progress.load) {
+            ImGui::Text("Unload %s", progress.path.GetText());
+        } else {
+            const float fraction =
+                progress.numKnownLayers ? static_cast<float>(progress.numOpenedLayers) / progress.numKnownLayers : 1.f;
+            const std::string overlay = std::to_string(progress.numOpenedLayers) + "/" +
+                                        std::to_string(progress.numKnownLayers) + " layers " + progress.path.GetString();
+            ImGui::ProgressBar(fraction, ImVec2(-1, 0), overlay.c_str());
+        }
+        ImGui::PopID();
+    }
+}
+
+void Editor::ShowLayerDiff(SdfLayerHandle layer) {
+    _showLayerDiff = true;
+    StartLayerDiff(layer);
+}
+
 void Editor::Draw() {
 
     NewFrame();
@@ -380,7 +560,7 @@ void Editor::Draw() {
         ImGuiWindowFlags windowFlags = 0 | ImGuiWindowFlags_MenuBar;
         ImGui::Begin("Property editor", &_showPropertyEditor, windowFlags);
         if (GetCurrentStage()) {
-            auto prim = GetCurrentStage()->GetPrimAtPath(GetSelectedPath(_selection));
+            auto prim = GetCurrentStage()->GetPrimAtPath(GetSelectedPath(GetViewport().GetSelection()));
             DrawUsdPrimProperties(prim, GetViewport().GetCurrentTimeCode());
         }
         ImGui::End();
@@ -388,7 +568,7 @@ void Editor::Draw() {
 
     if (_showOutliner) {
         ImGui::Begin("Stage outliner", &_showOutliner);
-        DrawStageOutliner(GetCurrentStage(), _selection);
+        DrawStageOutliner(GetCurrentStage(), GetViewport().GetSelection(), GetViewport().GetCurrentTimeCode());
         ImGui::End();
     }
 
@@ -428,6 +608,24 @@ void Editor::Draw() {
         ImGui::End();
     }
 
+    if (_showLoadRules) {
+        ImGui::Begin("Load rules", &_showLoadRules);
+        DrawLoadRulesEditor(GetCurrentStage(), GetViewport().GetSelection());
+        ImGui::End();
+    }
+
+    if (_showLayerDiff) {
+        ImGui::Begin("Layer diff", &_showLayerDiff);
+        DrawLayerDiffView(GetCurrentLayer());
+        ImGui::End();
+    }
+
+    if (!_payloadLoader.IsEmpty()) {
+        ImGui::Begin("Payloads");
+        DrawPayloadLoaderProgress(_payloadLoader);
+        ImGui::End();
+    }
+
     DrawCurrentModal();
 
     ///////////////////////
@@ -455,6 +653,11 @@ void Editor::Draw() {
 
     /////////////////
 
+    // The user commands go first, the loaded payloads are committed in a following frame
+    if (_payloadLoader.HasFinishedJobs()) {
+        ExecuteAfterDraw<EditorCommitPayloads>();
+    }
+
     EndBackgroundDock();
     ImGui::Render();
 }
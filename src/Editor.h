@@ -5,8 +5,10 @@
 #include <pxr/usd/sdf/primSpec.h>
 #include <Selection.h>
 #include <Viewport.h>
+#include <PayloadLoader.h>
 
 struct GLFWwindow;
+struct EditJournalReplayReport;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -51,9 +53,14 @@ public:
     void CreateLayer(const std::string &path);
     void ImportLayer(const std::string &path);
     void CreateStage(const std::string &path);
-    void ImportStage(const std::string &path);
+    /// Open a stage, only the prims in the population mask are composed
+    void ImportStage(const std::string &path, UsdStage::InitialLoadSet loadSet = UsdStage::LoadAll,
+                     const UsdStagePopulationMask &populationMask = UsdStagePopulationMask::All());
     void SaveCurrentLayerAs(const std::string &path);
 
+    /// Replay the edits of a journal left by a session which didn't exit cleanly, returns what was recovered
+    EditJournalReplayReport RecoverEdits(const std::string &journalPath);
+
     /// Render the hydra viewport
     void HydraRender();
 
@@ -73,6 +80,12 @@ public:
     /// There is only one viewport for now, but could have multiple in the future
     Viewport &GetViewport();
 
+    /// The payloads are loaded in the background and committed between the frames
+    PayloadLoader &GetPayloadLoader() { return _payloadLoader; }
+
+    /// Show the changes of the layer since it was saved, they are computed in the background
+    void ShowLayerDiff(SdfLayerHandle layer);
+
 private:
 
     /// Make sure the layer is correctly in the list of layers,
@@ -101,13 +114,15 @@ private:
     bool _showContentBrowser = false;
     bool _showPrimSpecEditor = false;
     bool _showViewport = false;
+    bool _showLoadRules = false;
+    bool _showLayerDiff = false;
 
     UsdStageRefPtr _currentStage;
+    // The viewport keeps a selection per stage
     Viewport _viewport;
 
-    // Editor owns the selection for the application
-    Selection _selection;
-
     /// Selected prim spec. This variable might move somewhere else
     SdfPrimSpecHandle _selectedPrimSpec;
+
+    PayloadLoader _payloadLoader;
 };
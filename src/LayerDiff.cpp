@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <pxr/base/work/loops.h>
+#include <pxr/usd/sdf/schema.h>
+#include "LayerDiff.h"
+#include "Commands.h"
+
+/// Number of spec paths listed while holding the stage edit lock
+static constexpr size_t ListBatchSize = 1024;
+
+/// Amount of work done while holding the stage edit lock when comparing: one unit per field and per array element
+static constexpr size_t CompareBatchWork = 1 << 20;
+
+/// Fields of the spec which are not the children lists, the children are compared as specs
+static std::vector<TfToken> ListValueFields(const SdfLayerRefPtr &layer, const SdfPath &path) {
+    std::vector<TfToken> fields = layer->ListFields(path);
+    fields.erase(std::remove_if(fields.begin(), fields.end(),
+                                [](const TfToken &field) {
+                                    return field == SdfChildrenKeys->PrimChildren ||
+                                           field == SdfChildrenKeys->PropertyChildren ||
+                                           field == SdfChildrenKeys->VariantSetChildren ||
+                                           field == SdfChildrenKeys->VariantChildren;
+                                }),
+                 fields.end());
+    std::sort(fields.begin(), fields.end(), TfTokenFastArbitraryLessThan());
+    return fields;
+}
+
+/// Append the paths of the children specs of the spec at path, the same specs as SdfLayer::Traverse
+static void AppendChildSpecPaths(const SdfLayerRefPtr &layer, const SdfPath &path, std::vector<SdfPath> &children) {
+    for (const auto &field : layer->ListFields(path)) {
+        if (field == SdfChildrenKeys->PrimChildren) {
+            for (const auto &name : layer->GetFieldAs<TfTokenVector>(path, field)) {
+                children.push_back(path.AppendChild(name));
+            }
+        } else if (field == SdfChildrenKeys->PropertyChildren) {
+            for (const auto &name : layer->GetFieldAs<TfTokenVector>(path, field)) {
+                children.push_back(path.AppendProperty(name));
+            }
+        } else if (field == SdfChildrenKeys->VariantSetChildren) {
+            for (const auto &name : layer->GetFieldAs<TfTokenVector>(path, field)) {
+                children.push_back(path.AppendVariantSelection(name, std::string()));
+            }
+        } else if (field == SdfChildrenKeys->VariantChildren) {
+            // The path is the variant set path /prim{set=}
+            const std::string variantSet = path.GetVariantSelection().first;
+            for (const auto &name : layer->GetFieldAs<TfTokenVector>(path, field)) {
+                children.push_back(path.GetParentPath().AppendVariantSelection(variantSet, name));
+            }
+        } else if (field == SdfChildrenKeys->ConnectionChildren || field == SdfChildrenKeys->RelationshipTargetChildren) {
+            for (const auto &target : layer->GetFieldAs<SdfPathVector>(path, field)) {
+                children.push_back(path.AppendTarget(target));
+            }
+        } else if (field == SdfChildrenKeys->MapperChildren) {
+            for (const auto &target : layer->GetFieldAs<SdfPathVector>(path, field)) {
+                children.push_back(path.AppendMapper(target));
+            }
+        } else if (field == SdfChildrenKeys->MapperArgChildren) {
+            for (const auto &name : layer->GetFieldAs<TfTokenVector>(path, field)) {
+                children.push_back(path.AppendMapperArg(name));
+            }
+        } else if (field == SdfChildrenKeys->ExpressionChildren) {
+            children.push_back(path.AppendExpression());
+        }
+    }
+}
+
+/// The fields only in the layer are added, the ones only in the base are removed. Returns the work done: one unit per
+/// field and per array element compared
+static size_t CompareSpecFields(const SdfLayerRefPtr &layer, const SdfLayerRefPtr &base, const SdfPath &path,
+                                std::vector<LayerDiff::FieldDiff> &fieldDiffs) {
+    size_t work = 0;
+    const std::vector<TfToken> layerFields = ListValueFields(layer, path);
+    const std::vector<TfToken> baseFields = ListValueFields(base, path);
+    auto layerField = layerFields.begin();
+    auto baseField = baseFields.begin();
+    const TfTokenFastArbitraryLessThan lessThan;
+    while (layerField != layerFields.end() || baseField != baseFields.end()) {
+        if (baseField == baseFields.end() || (layerField != layerFields.end() && lessThan(*layerField, *baseField))) {
+            fieldDiffs.push_back({*layerField++, LayerDiff::Change::Added});
+        } else if (layerField == layerFields.end() || lessThan(*baseField, *layerField)) {
+            fieldDiffs.push_back({*baseField++, LayerDiff::Change::Removed});
+        } else {
+            // The arrays sharing their buffer are equal without comparing the elements
+            const VtValue layerValue = layer->GetField(path, *layerField);
+            const VtValue baseValue = base->GetField(path, *baseField);
+            if (layerValue != baseValue) {
+                fieldDiffs.push_back({*layerField, LayerDiff::Change::Changed});
+            }
+            work += layerValue.IsArrayValued() ? layerValue.GetArraySize() : 0;
+            ++layerField;
+            ++baseField;
+        }
+        work++;
+    }
+    return work;
+}
+
+LayerDiff::~LayerDiff() {
+    Cancel();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+bool LayerDiff::Start(const SdfLayerHandle &layer, const SdfLayerHandle &base) {
+    if (_running) {
+        return false;
+    }
+    if (_thread.joinable()) {
+        _thread.join(); // Already finished
+    }
+    _layer = layer;
+    _base = base;
+    _specDiffs.clear();
+    _error.clear();
+    _outdated = false;
+    _cancelled = false;
+    _numComparedSpecs = 0;
+    _numSpecsToCompare = 0;
+    _editEpoch = GetStageEditEpoch();
+    if (!_layer) {
+        _phase = Phase::Idle;
+        return false;
+    }
+    _running = true;
+    _thread = std::thread(&LayerDiff::Run, this, !base);
+    return true;
+}
+
+void LayerDiff::Cancel() { _cancelled = true; }
+
+bool LayerDiff::MustStop() {
+    if (GetStageEditEpoch() != _editEpoch) {
+        _outdated = true;
+    }
+    return _cancelled || _outdated;
+}
+
+void LayerDiff::Run(bool readFile) {
+    if (readFile) {
+        _phase = Phase::Reading;
+        const std::string realPath = _layer->GetRealPath();
+        if (realPath.empty()) {
+            _error = "The layer has no file";
+        } else {
+            // An anonymous layer is a new read of the file, independent of the live layer
+            _base = SdfLayer::OpenAsAnonymous(realPath);
+            if (!_base) {
+                _error = "Unable to read " + realPath;
+            }
+        }
+    }
+    std::vector<SdfPath> layerPaths;
+    std::vector<SdfPath> basePaths;
+    if (_error.empty()) {
+        _phase = Phase::Listing;
+    }
+    // The base read from the file is only used by the diff, it is read without locking the stage edits
+    if (_error.empty() && ListSpecs(_layer, true, layerPaths) && ListSpecs(_base, !readFile, basePaths)) {
+        _phase = Phase::Comparing;
+        // The specs only in the layer are added, the ones only in the base are removed, the others are compared
+        std::vector<SdfPath> commonPaths;
+        auto layerPath = layerPaths.begin();
+        auto basePath = basePaths.begin();
+        while (layerPath != layerPaths.end() || basePath != basePaths.end()) {
+            if (basePath == basePaths.end() || (layerPath != layerPaths.end() && *layerPath < *basePath)) {
+                _specDiffs.push_back({*layerPath++, Change::Added, {}});
+            } else if (layerPath == layerPaths.end() || *basePath < *layerPath) {
+                _specDiffs.push_back({*basePath++, Change::Removed, {}});
+            } else {
+                commonPaths.push_back(*layerPath);
+                ++layerPath;
+                ++basePath;
+            }
+        }
+        CompareSpecs(commonPaths);
+        std::sort(_specDiffs.begin(), _specDiffs.end(), [](const SpecDiff &a, const SpecDiff &b) { return a.path < b.path; });
+    }
+    if (_cancelled || _outdated) {
+        _specDiffs.clear();
+    }
+    _phase = Phase::Finished;
+    _running = false;
+}
+
+/// List the spec paths of the layer sorted, each root prim is traversed by its own task. The layers which can be
+/// edited are read while holding the stage edit lock, released between the batches
+bool LayerDiff::ListSpecs(const SdfLayerRefPtr &layer, bool lockEdits, std::vector<SdfPath> &paths) {
+    std::vector<SdfPath> roots;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(GetStageEditMutex(), std::defer_lock);
+        if ((lockEdits && !LockStageEditsShared(lock, _cancelled)) || MustStop()) {
+            return false;
+        }
+        paths.push_back(SdfPath::AbsoluteRootPath());
+        AppendChildSpecPaths(layer, SdfPath::AbsoluteRootPath(), roots);
+    }
+    std::vector<std::vector<SdfPath>> rootPaths(roots.size());
+    WorkParallelForN(roots.size(), [&](size_t begin, size_t end) {
+        std::shared_lock<std::shared_timed_mutex> lock(GetStageEditMutex(), std::defer_lock);
+        if ((lockEdits && !LockStageEditsShared(lock, _cancelled)) || MustStop()) {
+            return;
+        }
+        size_t batchCount = 0;
+        std::vector<SdfPath> pendingPaths;
+        for (size_t rootIndex = begin; rootIndex < end; ++rootIndex) {
+            pendingPaths.assign(1, roots[rootIndex]);
+            while (!pendingPaths.empty()) {
+                const SdfPath path = std::move(pendingPaths.back());
+                pendingPaths.pop_back();
+                rootPaths[rootIndex].push_back(path);
+                AppendChildSpecPaths(layer, path, pendingPaths);
+                if (++batchCount == ListBatchSize) {
+                    batchCount = 0;
+                    // An edit stops the listing, the children paths pending are not valid anymore
+                    if (lock.owns_lock()) {
+                        lock.unlock();
+                    }
+                    if ((lockEdits && !LockStageEditsShared(lock, _cancelled)) || MustStop()) {
+                        return;
+                    }
+                }
+            }
+        }
+    });
+    if (MustStop()) {
+        return false;
+    }
+    for (auto &pathsOfRoot : rootPaths) {
+        paths.insert(paths.end(), pathsOfRoot.begin(), pathsOfRoot.end());
+    }
+    std::sort(paths.begin(), paths.end());
+    return true;
+}
+
+/// The specs are compared in parallel, each task releases the stage edit lock once it has done CompareBatchWork
+void LayerDiff::CompareSpecs(const std::vector<SdfPath> &paths) {
+    _numSpecsToCompare = paths.size();
+    std::mutex specDiffsMutex;
+    WorkParallelForN(paths.size(), [&](size_t begin, size_t end) {
+        std::vector<SpecDiff> specDiffs;
+        std::shared_lock<std::shared_timed_mutex> lock(GetStageEditMutex(), std::defer_lock);
+        if (!LockStageEditsShared(lock, _cancelled) || MustStop()) {
+            return;
+        }
+        size_t work = 0;
+        size_t numCompared = 0;
+        for (size_t pathIndex = begin; pathIndex < end; ++pathIndex) {
+            SpecDiff specDiff{paths[pathIndex], Change::Changed, {}};
+            work += CompareSpecFields(_layer, _base, specDiff.path, specDiff.fields);
+            if (!specDiff.fields.empty()) {
+                specDiffs.push_back(std::move(specDiff));
+            }
+            numCompared++;
+            if (work >= CompareBatchWork) {
+                work = 0;
+                _numComparedSpecs += numCompared;
+                numCompared = 0;
+                lock.unlock();
+                if (!LockStageEditsShared(lock, _cancelled) || MustStop()) {
+                    return;
+                }
+            }
+        }
+        _numComparedSpecs += numCompared;
+        lock.unlock();
+        std::lock_guard<std::mutex> resultsLock(specDiffsMutex);
+        _specDiffs.insert(_specDiffs.end(), std::make_move_iterator(specDiffs.begin()),
+                          std::make_move_iterator(specDiffs.end()));
+    });
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pxr/usd/sdf/layer.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// Structural diff of two layers, computed on a worker thread.
+///
+/// The specs of both layers are listed, one task per root prim, then the specs present in both layers are compared
+/// field by field in parallel. The live layers are read while holding the stage edit lock shared, by batches sized
+/// by the number of specs listed or array elements compared. An edit stops the diff and the result is marked as
+/// outdated.
+///
+class LayerDiff final {
+  public:
+    enum class Change : char { Added, Removed, Changed };
+
+    struct FieldDiff {
+        TfToken field;
+        Change change;
+    };
+
+    struct SpecDiff {
+        SdfPath path;
+        Change change;
+        std::vector<FieldDiff> fields; // Only for the changed specs
+    };
+
+    enum class Phase { Idle, Reading, Listing, Comparing, Finished };
+
+    LayerDiff() = default;
+    ~LayerDiff();
+
+    // Delete copy
+    LayerDiff(const LayerDiff &) = delete;
+    LayerDiff &operator=(const LayerDiff &) = delete;
+
+    /// Find the changes from base to layer. A null base is a fresh read of the file of the layer, to find the unsaved
+    /// changes. Returns false if the previous diff is still running
+    bool Start(const SdfLayerHandle &layer, const SdfLayerHandle &base);
+
+    /// Ask the running diff to stop, it doesn't wait. Reading a file can't be interrupted
+    void Cancel();
+
+    bool IsRunning() const { return _running; }
+    Phase GetPhase() const { return _phase; }
+
+    /// Progress of the comparison of the specs present in both layers
+    size_t GetNumComparedSpecs() const { return _numComparedSpecs; }
+    size_t GetNumSpecsToCompare() const { return _numSpecsToCompare; }
+
+    /// The compared layers, the base is the file read from disk when comparing with the file
+    const SdfLayerRefPtr &GetLayer() const { return _layer; }
+    const SdfLayerRefPtr &GetBaseLayer() const { return _base; }
+
+    /// Results of the last diff sorted by path, only valid when it isn't running
+    const std::vector<SpecDiff> &GetSpecDiffs() const { return _specDiffs; }
+    const std::string &GetError() const { return _error; }
+
+    /// The layers were edited during the diff, it was stopped
+    bool IsOutdated() const { return _outdated; }
+
+  private:
+    void Run(bool readFile);
+    bool ListSpecs(const SdfLayerRefPtr &layer, bool lockEdits, std::vector<SdfPath> &paths);
+    void CompareSpecs(const std::vector<SdfPath> &paths);
+    bool MustStop();
+
+    std::thread _thread;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _cancelled{false};
+    std::atomic<Phase> _phase{Phase::Idle};
+    std::atomic<size_t> _numComparedSpecs{0};
+    std::atomic<size_t> _numSpecsToCompare{0};
+    uint64_t _editEpoch = 0;
+
+    // Written by the worker, read when it's finished
+    SdfLayerRefPtr _layer;
+    SdfLayerRefPtr _base;
+    std::vector<SpecDiff> _specDiffs;
+    std::string _error;
+    std::atomic<bool> _outdated{false}; // Set by the tasks
+};
@@ -0,0 +1,227 @@
+#include <shared_mutex>
+#include <unordered_set>
+#include <pxr/usd/ar/resolverContextBinder.h>
+#include <pxr/usd/sdf/layerUtils.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/usd/primRange.h>
+#include "PayloadLoader.h"
+#include "Commands.h"
+
+struct PayloadJob {
+    UsdStageWeakPtr stage;
+    SdfPath path;
+    bool load = true;
+    ArResolverContext resolverContext;
+
+    std::vector<std::string> pendingAssets;           // Anchored asset paths of the layers to open
+    std::unordered_set<std::string> knownAssets;      // The layers opened or to open, the cycles are opened once
+    SdfLayerRefPtrVector layers;                      // Kept open until the commit
+    size_t numOpenedLayers = 0;
+    bool finished = false;
+    bool cancelled = false;
+};
+
+void CollectPayloadAssetPaths(const UsdPrim &prim, std::vector<std::string> &assetPaths) {
+    UsdPrimRange range(prim, UsdPrimAllPrimsPredicate);
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        if (!it->HasAuthoredPayloads() || it->IsLoaded()) {
+            continue;
+        }
+        for (const auto &spec : it->GetPrimStack()) {
+            for (const auto &payload : spec->GetPayloadList().GetAppliedItems()) {
+                // An internal payload is in a layer already opened by the stage
+                if (!payload.GetAssetPath().empty()) {
+                    assetPaths.push_back(SdfComputeAssetPathRelativeToLayer(spec->GetLayer(), payload.GetAssetPath()));
+                }
+            }
+        }
+        it.PruneChildren(); // An unloaded prim doesn't have children
+    }
+}
+
+PayloadLoader::~PayloadLoader() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopWorker = true;
+    }
+    _wakeUp.notify_one();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+void PayloadLoader::Load(const UsdPrim &prim) { Queue(prim, true); }
+
+void PayloadLoader::Unload(const UsdPrim &prim) { Queue(prim, false); }
+
+void PayloadLoader::Queue(const UsdPrim &prim, bool load) {
+    if (!prim) {
+        return;
+    }
+    auto job = std::make_shared<PayloadJob>();
+    job->stage = prim.GetStage();
+    job->path = prim.GetPath();
+    job->load = load;
+    if (load) {
+        job->resolverContext = prim.GetStage()->GetPathResolverContext();
+        CollectPayloadAssetPaths(prim, job->pendingAssets);
+        job->knownAssets.insert(job->pendingAssets.begin(), job->pendingAssets.end());
+    }
+    // The unloads, and the loads of payloads already open in the registry, are ready to commit
+    job->finished = job->pendingAssets.empty();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _jobs.begin(); it != _jobs.end();) {
+            if ((*it)->stage == job->stage && (*it)->path == job->path) {
+                (*it)->cancelled = true;
+                it = _jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        _jobs.push_back(job);
+    }
+    StartWorker();
+    _wakeUp.notify_one();
+}
+
+void PayloadLoader::Cancel(const UsdStageWeakPtr &stage, const SdfPath &path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _jobs.begin(); it != _jobs.end(); ++it) {
+        if ((*it)->stage == stage && (*it)->path == path) {
+            (*it)->cancelled = true;
+            _jobs.erase(it);
+            return;
+        }
+    }
+}
+
+void PayloadLoader::CancelAll() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &job : _jobs) {
+        job->cancelled = true;
+    }
+    _jobs.clear();
+}
+
+bool PayloadLoader::HasFinishedJobs() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto &job : _jobs) {
+        if (job->finished) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PayloadLoader::IsEmpty() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _jobs.empty();
+}
+
+std::vector<PayloadLoader::Progress> PayloadLoader::GetProgress() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<Progress> progress;
+    progress.reserve(_jobs.size());
+    for (const auto &job : _jobs) {
+        progress.push_back(Progress{job->stage, job->path, job->load, job->numOpenedLayers, job->knownAssets.size(), job->finished});
+    }
+    return progress;
+}
+
+void PayloadLoader::Commit() {
+    std::vector<std::shared_ptr<PayloadJob>> finished;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _jobs.begin(); it != _jobs.end();) {
+            if ((*it)->finished) {
+                finished.push_back(*it);
+                it = _jobs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    // The requests on a stage are applied in one call, so it is recomposed once
+    for (size_t first = 0; first < finished.size(); ++first) {
+        const UsdStageWeakPtr stage = finished[first]->stage;
+        if (!stage) {
+            continue;
+        }
+        SdfPathSet loads;
+        SdfPathSet unloads;
+        for (size_t index = first; index < finished.size(); ++index) {
+            if (finished[index]->stage == stage) {
+                (finished[index]->load ? loads : unloads).insert(finished[index]->path);
+                finished[index]->stage = UsdStageWeakPtr();
+            }
+        }
+        stage->LoadAndUnload(loads, unloads, UsdLoadWithDescendants);
+    }
+    // The opened layers are released here, the stages now hold the ones they use
+}
+
+void PayloadLoader::StartWorker() {
+    if (!_worker.joinable()) {
+        _worker = std::thread(&PayloadLoader::Work, this);
+    }
+}
+
+void PayloadLoader::Work() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        std::shared_ptr<PayloadJob> job;
+        _wakeUp.wait(lock, [&]() {
+            for (const auto &pending : _jobs) {
+                if (!pending->finished) {
+                    job = pending;
+                    break;
+                }
+            }
+            return _stopWorker || job;
+        });
+        if (_stopWorker) {
+            return;
+        }
+        lock.unlock();
+        OpenLayers(*job);
+        lock.lock();
+    }
+}
+
+/// Open the layers of the job one by one, the layers found in the opened ones are added to the job.
+/// The job is read and modified with the loader mutex held, the layers are opened without it.
+void PayloadLoader::OpenLayers(PayloadJob &job) {
+    ArResolverContextBinder binder(job.resolverContext);
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!job.cancelled && !_stopWorker && !job.pendingAssets.empty()) {
+        const std::string assetPath = job.pendingAssets.back();
+        job.pendingAssets.pop_back();
+        lock.unlock();
+
+        SdfLayerRefPtr layer = SdfLayer::FindOrOpen(assetPath);
+        std::vector<std::string> dependencies;
+        if (layer) {
+            // The layer might be already used and edited by a stage, it is read between the edits
+            std::shared_lock<std::shared_timed_mutex> editLock(GetStageEditMutex());
+            for (const auto &dependency : layer->GetCompositionAssetDependencies()) {
+                dependencies.push_back(SdfComputeAssetPathRelativeToLayer(layer, dependency));
+            }
+        }
+
+        lock.lock();
+        // A layer which can't be opened is counted anyway, the stage reports the error when loading
+        job.numOpenedLayers++;
+        if (layer) {
+            job.layers.push_back(layer);
+        }
+        for (auto &dependency : dependencies) {
+            if (job.knownAssets.insert(dependency).second) {
+                job.pendingAssets.push_back(std::move(dependency));
+            }
+        }
+    }
+    if (!job.cancelled && job.pendingAssets.empty()) {
+        job.finished = true;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+struct PayloadJob;
+
+/// Anchored asset paths of the payloads which are not loaded under prim, prim included.
+/// The payloads brought by the payload layers are only known once these layers are opened
+void CollectPayloadAssetPaths(const UsdPrim &prim, std::vector<std::string> &assetPaths);
+
+///
+/// Loads the payloads in the background.
+///
+/// Loading a payload on the ui thread blocks the editor while the payload layers and all the layers they bring are
+/// read. The loader opens those layers on a worker thread and keeps them alive, the stage is left untouched and stays
+/// interactive. When all the layers of a payload are open, the load is committed with UsdStage::LoadAndUnload which
+/// only composes the already opened layers.
+/// The unloads don't need any preparation, they are committed with the finished loads of the same stage.
+///
+class PayloadLoader final {
+  public:
+    PayloadLoader() = default;
+    ~PayloadLoader();
+
+    // Delete copy
+    PayloadLoader(const PayloadLoader &) = delete;
+    PayloadLoader &operator=(const PayloadLoader &) = delete;
+
+    /// Queue the load of the payloads of prim and its descendants, replacing a pending request on the same prim
+    void Load(const UsdPrim &prim);
+
+    /// Queue the unload of prim and its descendants, replacing a pending request on the same prim
+    void Unload(const UsdPrim &prim);
+
+    /// Drop the pending request on path, the stage is not modified
+    void Cancel(const UsdStageWeakPtr &stage, const SdfPath &path);
+    void CancelAll();
+
+    /// Returns true when some requests are ready to be committed
+    bool HasFinishedJobs() const;
+
+    /// Apply the finished requests to their stages. It modifies the stages and must be called between the frames
+    void Commit();
+
+    struct Progress {
+        UsdStageWeakPtr stage;
+        SdfPath path;
+        bool load;
+        size_t numOpenedLayers;
+        size_t numKnownLayers; // Grows while the opened layers reveal their dependencies
+        bool finished;
+    };
+
+    /// State of the pending requests, in request order
+    std::vector<Progress> GetProgress() const;
+
+    bool IsEmpty() const;
+
+  private:
+    void Queue(const UsdPrim &prim, bool load);
+    void StartWorker();
+    void Work();
+    void OpenLayers(PayloadJob &job);
+
+    mutable std::mutex _mutex; // Protects the jobs and their progress
+    std::condition_variable _wakeUp;
+    std::list<std::shared_ptr<PayloadJob>> _jobs;
+    std::thread _worker;
+    bool _stopWorker = false;
+};
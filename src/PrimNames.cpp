@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/sdf/notice.h>
+#include <pxr/usd/sdf/schema.h>
+#include "PrimNames.h"
+
+/// Default number of digits of the generated names
+static constexpr size_t DefaultNamePadding = 4;
+
+/// Longest number suffix considered, the longer ones can't be generated
+static constexpr size_t MaxSuffixDigits = 18;
+
+/// A name split in a prefix and a number suffix
+struct NumberedName {
+    std::string prefix;
+    uint64_t number = 0;
+    size_t numDigits = 0;
+};
+
+static NumberedName SplitNumberedName(const std::string &name) {
+    size_t end = name.size();
+    while (end > 0 && std::isdigit(static_cast<unsigned char>(name[end - 1]))) {
+        end--;
+    }
+    NumberedName numberedName;
+    numberedName.prefix = name.substr(0, end);
+    numberedName.numDigits = name.size() - end;
+    if (numberedName.numDigits > 0 && numberedName.numDigits <= MaxSuffixDigits) {
+        numberedName.number = std::stoull(name.substr(end));
+    }
+    return numberedName;
+}
+
+///
+/// Greatest number suffix per prefix of the children of the parents. A new name takes the next number, so it doesn't
+/// have to be checked against the children. The numbers of the removed children are not reused.
+///
+class PrimNameIndex : public TfWeakBase {
+  public:
+    PrimNameIndex() { _noticeKey = TfNotice::Register(TfCreateWeakPtr(this), &PrimNameIndex::OnLayersDidChange); }
+    ~PrimNameIndex() { TfNotice::Revoke(_noticeKey); }
+
+    /// Reserve count numbers after the greatest one of the prefix under the parent, returns the first one
+    uint64_t ReserveNumbers(const SdfLayerHandle &layer, const SdfPath &parentPath, const NumberedName &name, size_t count) {
+        ParentIndex &parentIndex = GetParentIndex(layer, parentPath);
+        uint64_t &greatestNumber = parentIndex[name.prefix];
+        const uint64_t first = std::max(greatestNumber, name.number) + 1;
+        greatestNumber = first + count - 1;
+        return first;
+    }
+
+  private:
+    using ParentIndex = std::unordered_map<std::string, uint64_t>; // Prefix -> greatest number
+    using LayerIndex = std::unordered_map<SdfPath, ParentIndex, SdfPath::Hash>;
+
+    static void AddName(ParentIndex &parentIndex, const std::string &name) {
+        const NumberedName numberedName = SplitNumberedName(name);
+        if (numberedName.numDigits > 0) {
+            uint64_t &greatestNumber = parentIndex[numberedName.prefix];
+            greatestNumber = std::max(greatestNumber, numberedName.number);
+        }
+    }
+
+    /// The indices of the released layers are deleted
+    void EraseReleasedLayers() {
+        for (auto layerIndex = _layers.begin(); layerIndex != _layers.end();) {
+            layerIndex = layerIndex->first.IsInvalid() ? _layers.erase(layerIndex) : std::next(layerIndex);
+        }
+    }
+
+    ParentIndex &GetParentIndex(const SdfLayerHandle &layer, const SdfPath &parentPath) {
+        if (_layers.find(layer) == _layers.end()) {
+            EraseReleasedLayers();
+        }
+        LayerIndex &layerIndex = _layers[layer];
+        auto inserted = layerIndex.emplace(parentPath, ParentIndex());
+        if (inserted.second) {
+            for (const auto &child : layer->GetFieldAs<TfTokenVector>(parentPath, SdfChildrenKeys->PrimChildren)) {
+                AddName(inserted.first->second, child.GetString());
+            }
+        }
+        return inserted.first->second;
+    }
+
+    /// The indexed parents are updated with their new children
+    void OnLayersDidChange(const SdfNotice::LayersDidChange &notice) {
+        EraseReleasedLayers();
+        for (const auto &layerChanges : notice.GetChangeListVec()) {
+            auto layerIndex = _layers.find(layerChanges.first);
+            if (layerIndex == _layers.end()) {
+                continue;
+            }
+            for (const auto &entry : layerChanges.second.GetEntryList()) {
+                const SdfPath &path = entry.first;
+                const auto &flags = entry.second.flags;
+                if (path.IsAbsoluteRootPath() && (flags.didReloadContent || flags.didReplaceContent)) {
+                    _layers.erase(layerIndex);
+                    break;
+                }
+                if ((flags.didAddInertPrim || flags.didAddNonInertPrim || flags.didRename) && path.IsPrimPath()) {
+                    auto parentIndex = layerIndex->second.find(path.GetParentPath());
+                    if (parentIndex != layerIndex->second.end()) {
+                        AddName(parentIndex->second, path.GetName());
+                    }
+                }
+            }
+        }
+    }
+
+    std::map<SdfLayerHandle, LayerIndex> _layers;
+    TfNotice::Key _noticeKey;
+};
+
+static PrimNameIndex &GetPrimNameIndex() {
+    static PrimNameIndex primNameIndex;
+    return primNameIndex;
+}
+
+static std::string FormatPrimName(const std::string &prefix, uint64_t number, size_t padding) {
+    const std::string digits = std::to_string(number);
+    std::string name;
+    name.reserve(prefix.size() + std::max(padding, digits.size()));
+    name += prefix;
+    if (digits.size() < padding) {
+        name.append(padding - digits.size(), '0');
+    }
+    name += digits;
+    return name;
+}
+
+std::vector<std::string> FindNextAvailablePrimNames(const SdfLayerHandle &layer, const SdfPath &parentPath,
+                                                    const std::string &prefix, size_t count) {
+    std::vector<std::string> names;
+    if (!layer || count == 0) {
+        return names;
+    }
+    const NumberedName name = SplitNumberedName(prefix);
+    const size_t padding = name.numDigits ? name.numDigits : DefaultNamePadding;
+    const uint64_t first = GetPrimNameIndex().ReserveNumbers(layer, parentPath, name, count);
+    names.reserve(count);
+    for (uint64_t number = first; number < first + count; ++number) {
+        names.push_back(FormatPrimName(name.prefix, number, padding));
+    }
+    return names;
+}
+
+std::string FindNextAvailablePrimName(const SdfLayerHandle &layer, const SdfPath &parentPath, const std::string &prefix) {
+    const std::vector<std::string> names = FindNextAvailablePrimNames(layer, parentPath, prefix, 1);
+    return names.empty() ? prefix : names.front();
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/path.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// Name made of the prefix followed by a number which is not a child of parentPath in the layer.
+/// If the prefix ends with a number, the new number is greater. The names are generated in constant time from an
+/// index of the numbered children of the parent, built once per parent and updated by the layer notices
+std::string FindNextAvailablePrimName(const SdfLayerHandle &layer, const SdfPath &parentPath, const std::string &prefix);
+
+/// Same as FindNextAvailablePrimName for count new prims, the names are all different
+std::vector<std::string> FindNextAvailablePrimNames(const SdfLayerHandle &layer, const SdfPath &parentPath,
+                                                    const std::string &prefix, size_t count);
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <regex>
+#include <shared_mutex>
+#include <pxr/base/work/loops.h>
+#include <pxr/usd/usd/modelAPI.h>
+#include <pxr/usd/usd/primRange.h>
+#include "PrimSearch.h"
+#include "Commands.h"
+
+/// Number of prims traversed while holding the stage edit lock
+static constexpr size_t SearchBatchSize = 256;
+
+static std::string ToLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+/// Convert a wildcard pattern to a regular expression
+static std::string WildcardToRegex(const std::string &pattern) {
+    std::string regex;
+    for (const char c : pattern) {
+        if (c == '*') {
+            regex += ".*";
+        } else if (c == '?') {
+            regex += '.';
+        } else if (std::strchr("\\^$.|+()[]{}", c)) {
+            regex += '\\';
+            regex += c;
+        } else {
+            regex += c;
+        }
+    }
+    return regex;
+}
+
+struct PrimSearchMatcher {
+    bool matchPaths = false;
+    bool useRegex = false;
+    std::string text; // lower case, when the regex is not used
+    std::regex regex;
+
+    bool Matches(const std::string &candidate) const {
+        if (useRegex) {
+            return std::regex_search(candidate, regex);
+        }
+        return ToLower(candidate).find(text) != std::string::npos;
+    }
+
+    bool Matches(const UsdPrim &prim) const {
+        if (matchPaths) {
+            return Matches(prim.GetPath().GetString());
+        }
+        if (Matches(prim.GetName().GetString()) || Matches(prim.GetTypeName().GetString())) {
+            return true;
+        }
+        TfToken kind;
+        if (UsdModelAPI(prim).GetKind(&kind) && !kind.IsEmpty() && Matches(kind.GetString())) {
+            return true;
+        }
+        for (const auto &schema : prim.GetAppliedSchemas()) {
+            if (Matches(schema.GetString())) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+PrimSearch::~PrimSearch() { Cancel(); }
+
+bool PrimSearch::Start(const UsdStageRefPtr &stage, const std::string &query, bool isRegex) {
+    Cancel();
+    {
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        _results.clear();
+    }
+    _interrupted = false;
+    if (!stage || query.empty()) {
+        return true;
+    }
+
+    auto matcher = std::make_shared<PrimSearchMatcher>();
+    matcher->matchPaths = query.find('/') != std::string::npos;
+    const bool hasWildcards = query.find_first_of("*?") != std::string::npos;
+    matcher->useRegex = isRegex || hasWildcards;
+    if (matcher->useRegex) {
+        try {
+            // A wildcard pattern matches the whole name
+            const std::string expression = isRegex ? query : "^" + WildcardToRegex(query) + "$";
+            matcher->regex = std::regex(expression, std::regex::icase | std::regex::optimize);
+        } catch (const std::regex_error &) {
+            return false;
+        }
+    } else {
+        matcher->text = ToLower(query);
+    }
+
+    _cancelled = false;
+    _running = true;
+    _thread = std::thread(&PrimSearch::Search, this, stage, std::shared_ptr<const PrimSearchMatcher>(matcher),
+                          GetStageEditEpoch());
+    return true;
+}
+
+void PrimSearch::Cancel() {
+    _cancelled = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    _running = false;
+}
+
+bool PrimSearch::FetchResults(SdfPathVector &paths) {
+    std::lock_guard<std::mutex> lock(_resultsMutex);
+    if (_results.empty()) {
+        return false;
+    }
+    paths.insert(paths.end(), std::make_move_iterator(_results.begin()), std::make_move_iterator(_results.end()));
+    _results.clear();
+    return true;
+}
+
+void PrimSearch::PushResults(SdfPathVector &paths) {
+    if (!paths.empty()) {
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        _results.insert(_results.end(), std::make_move_iterator(paths.begin()), std::make_move_iterator(paths.end()));
+        paths.clear();
+    }
+}
+
+void PrimSearch::Search(UsdStageRefPtr stage, std::shared_ptr<const PrimSearchMatcher> matcher, uint64_t editEpoch) {
+    std::shared_lock<std::shared_timed_mutex> lock(GetStageEditMutex(), std::defer_lock);
+    const auto stopSearching = [&]() {
+        if (GetStageEditEpoch() != editEpoch) {
+            _interrupted = true;
+        }
+        return _cancelled || _interrupted;
+    };
+
+    // The roots are copied, the parallel traversal doesn't touch the stage outside of the batches
+    std::vector<UsdPrim> roots;
+    if (!LockStageEditsShared(lock, _cancelled)) {
+        _running = false;
+        return;
+    }
+    if (!stopSearching()) {
+        for (const auto &root : stage->GetPseudoRoot().GetAllChildren()) {
+            roots.push_back(root);
+        }
+    }
+    lock.unlock();
+
+    WorkParallelForEach(roots.begin(), roots.end(), [&](const UsdPrim &root) {
+        std::shared_lock<std::shared_timed_mutex> batchLock(GetStageEditMutex(), std::defer_lock);
+        if (!LockStageEditsShared(batchLock, _cancelled) || stopSearching()) {
+            return;
+        }
+        SdfPathVector found;
+        size_t batchCount = 0;
+        for (const UsdPrim &prim : UsdPrimRange(root, UsdPrimAllPrimsPredicate)) {
+            if (matcher->Matches(prim)) {
+                found.push_back(prim.GetPath());
+            }
+            if (++batchCount == SearchBatchSize) {
+                batchCount = 0;
+                PushResults(found);
+                // Give a pending edit the chance to take the lock. The traversal can't continue after an edit
+                if (stopSearching()) {
+                    return;
+                }
+                batchLock.unlock();
+                if (!LockStageEditsShared(batchLock, _cancelled) || stopSearching()) {
+                    return;
+                }
+            }
+        }
+        PushResults(found);
+    });
+    _running = false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+struct PrimSearchMatcher;
+
+///
+/// Search of the prims of a stage matching a query, running in the background.
+///
+/// The query is a case insensitive text, a wildcard pattern with * and ?, or a regular expression. It is matched
+/// against the prim names, type names, kinds and applied schemas, or against the prim paths when it contains a '/'.
+/// The root prims are traversed in parallel, the matching paths are streamed back and fetched by the ui thread.
+/// The search is cancelled when a new one starts. It stops when a stage edit is pending, the owner has to restart it
+/// once the edit is done.
+///
+class PrimSearch final {
+  public:
+    PrimSearch() = default;
+    ~PrimSearch();
+
+    // Delete copy
+    PrimSearch(const PrimSearch &) = delete;
+    PrimSearch &operator=(const PrimSearch &) = delete;
+
+    /// Start a new search, cancelling the running one. Returns false if the query is not a valid expression
+    bool Start(const UsdStageRefPtr &stage, const std::string &query, bool isRegex);
+
+    /// Stop the search and wait for the background thread
+    void Cancel();
+
+    /// Append the paths found since the last fetch to paths. Returns false if there was none
+    bool FetchResults(SdfPathVector &paths);
+
+    bool IsRunning() const { return _running; }
+
+    /// The search was stopped by a stage edit before the end of the traversal
+    bool WasInterrupted() const { return _interrupted; }
+
+  private:
+    void Search(UsdStageRefPtr stage, std::shared_ptr<const PrimSearchMatcher> matcher, uint64_t editEpoch);
+    void PushResults(SdfPathVector &paths);
+
+    std::thread _thread;
+    std::atomic<bool> _cancelled{false};
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _interrupted{false};
+
+    std::mutex _resultsMutex;
+    SdfPathVector _results; // Found and not fetched yet
+};
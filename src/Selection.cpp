@@ -1,90 +1,257 @@
-#include <functional>
+#include <algorithm>
 #include "Selection.h"
 
-// TODO create a class for the selection to avoid statics.
-// At the moment there is only one selection object in editor but when we'll
-// use multiple selection this won't work at all
-
-static SelectionHash selectionHash = 0;
-static bool mustRecomputeHash = true;
-
-/// Note the following bit of code might have terrible performances when selecting thousands of paths
-/// This has to be tested at some point
-namespace std {
-template <> struct hash<SdfPathVector> {
-    std::size_t operator()(SdfPathVector const &paths) const noexcept {
-        std::size_t hashValue = 0;
-        for (const auto p : paths) {
-            const auto pathHash = SdfPath::Hash{}(p);
-            hashValue = pathHash ^ (hashValue << 1);
+// At the moment there is only one selection object in the editor, but as the state is now in the Selection
+// class, multiple selections will work as well
+
+/// Mix the path hash so that the sum of the hashes of the selected paths doesn't collide easily.
+/// (splitmix64 finalizer)
+static inline size_t MixPathHash(size_t hash) {
+    uint64_t x = static_cast<uint64_t>(hash);
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return static_cast<size_t>(x);
+}
+
+void Selection::Clear() {
+    if (_size || !_paths.empty()) {
+        _slots.clear();
+        _paths.clear();
+        _selectedDescendants.clear();
+        _size = 0;
+        _hash = 0;
+        _generation++;
+        // Removing every path one by one would be as slow as reading the new selection
+        _changes.clear();
+        _changesStart = _generation;
+    }
+}
+
+void Selection::LogChange(const SdfPath &path, bool added) {
+    _changes.push_back(Change{_generation, path, added});
+    // The log is trimmed when it gets much bigger than the selection, the clients lagging behind will
+    // read the whole selection
+    constexpr size_t minLogSize = 1024;
+    if (_changes.size() > 2 * std::max(minLogSize, _size)) {
+        const size_t numDropped = _changes.size() / 2;
+        _changesStart = _changes[numDropped - 1].generation;
+        _changes.erase(_changes.begin(), _changes.begin() + numDropped);
+    }
+}
+
+void Selection::AddToAncestors(const SdfPath &path) {
+    for (SdfPath ancestor = path.GetParentPath(); !ancestor.IsEmpty(); ancestor = ancestor.GetParentPath()) {
+        _selectedDescendants[ancestor]++;
+    }
+}
+
+void Selection::RemoveFromAncestors(const SdfPath &path) {
+    // When an ancestor doesn't have selected descendants anymore, neither do its descendants, so only the topmost
+    // one is erased with its subtree
+    SdfPath topmostUnused;
+    for (SdfPath ancestor = path.GetParentPath(); !ancestor.IsEmpty(); ancestor = ancestor.GetParentPath()) {
+        auto it = _selectedDescendants.find(ancestor);
+        if (it != _selectedDescendants.end() && --it->second == 0) {
+            topmostUnused = ancestor;
+        }
+    }
+    if (!topmostUnused.IsEmpty()) {
+        _selectedDescendants.erase(topmostUnused);
+    }
+}
+
+bool Selection::GetChanges(uint64_t sinceGeneration, std::vector<SdfPath> &added, std::vector<SdfPath> &removed) const {
+    if (sinceGeneration < _changesStart || sinceGeneration > _generation) {
+        return false;
+    }
+    auto change = std::upper_bound(_changes.begin(), _changes.end(), sinceGeneration,
+                                   [](uint64_t generation, const Change &change) { return generation < change.generation; });
+    for (; change != _changes.end(); ++change) {
+        (change->added ? added : removed).push_back(change->path);
+    }
+    return true;
+}
+
+size_t Selection::FindSlot(const SdfPath &path, size_t hash) const {
+    const size_t mask = _slots.size() - 1;
+    size_t pos = hash & mask;
+    while (_slots[pos].index != EmptySlot) {
+        if (_slots[pos].hash == hash && _paths[_slots[pos].index] == path) {
+            return pos;
         }
-        return hashValue;
+        pos = (pos + 1) & mask;
     }
-};
-} // namespace std
+    return pos;
+}
 
-static std::size_t GetSelectionHash(const Selection &selection) {
-    if (selection && mustRecomputeHash) {
-        auto paths = selection->GetAllSelectedPrimPaths();
-        selectionHash = std::hash<SdfPathVector>{}(paths);
+void Selection::Rehash(size_t capacity) {
+    _slots.assign(capacity, Slot{0, EmptySlot});
+    const size_t mask = capacity - 1;
+    for (uint32_t index = 0; index < _paths.size(); ++index) {
+        if (_paths[index].IsEmpty())
+            continue;
+        const size_t hash = MixPathHash(SdfPath::Hash{}(_paths[index]));
+        size_t pos = hash & mask;
+        while (_slots[pos].index != EmptySlot) {
+            pos = (pos + 1) & mask;
+        }
+        _slots[pos] = Slot{hash, index};
     }
-    return selectionHash;
 }
 
-/// Clear selection, editor implementation
-void ClearSelection(Selection &selection) {
-    selection.reset(new HdSelection());
-    mustRecomputeHash = true;
+/// Remove the holes left in _paths by Remove
+void Selection::Compact() {
+    _paths.erase(std::remove_if(_paths.begin(), _paths.end(), [](const SdfPath &path) { return path.IsEmpty(); }),
+                 _paths.end());
+    Rehash(_slots.size());
 }
 
-void AddSelection(Selection &selection, const SdfPath &path) {
-    if (!selection) {
-        selection.reset(new HdSelection());
+bool Selection::Add(const SdfPath &path) {
+    if (path.IsEmpty())
+        return false;
+    // Keep the load factor under 1/2 to have short probe sequences
+    if ((_paths.size() + 1) * 2 > _slots.size()) {
+        if (_size * 2 < _paths.size()) {
+            Compact();
+        }
+        if ((_paths.size() + 1) * 2 > _slots.size()) {
+            Rehash(std::max<size_t>(16, _slots.size() * 2));
+        }
+    }
+    const size_t hash = MixPathHash(SdfPath::Hash{}(path));
+    const size_t pos = FindSlot(path, hash);
+    if (_slots[pos].index != EmptySlot) {
+        return false;
     }
-    selection->AddRprim(HdSelection::HighlightModeSelect, path);
-    mustRecomputeHash = true;
+    _slots[pos] = Slot{hash, static_cast<uint32_t>(_paths.size())};
+    _paths.push_back(path);
+    AddToAncestors(path);
+    _size++;
+    _hash += hash;
+    _generation++;
+    LogChange(path, true);
+    return true;
 }
 
-void SetSelected(Selection &selection, const SdfPath &path) {
-    selection.reset(new HdSelection());
-    selection->AddRprim(HdSelection::HighlightModeSelect, path);
-    mustRecomputeHash = true;
+bool Selection::Remove(const SdfPath &path) {
+    if (_size == 0)
+        return false;
+    const size_t hash = MixPathHash(SdfPath::Hash{}(path));
+    size_t pos = FindSlot(path, hash);
+    if (_slots[pos].index == EmptySlot) {
+        return false;
+    }
+    _paths[_slots[pos].index] = SdfPath();
+    RemoveFromAncestors(path);
+    _size--;
+    _hash -= hash;
+    _generation++;
+    LogChange(path, false);
+
+    // Backward shift deletion, the following entries of the probe sequence are moved to fill the hole
+    const size_t mask = _slots.size() - 1;
+    size_t next = (pos + 1) & mask;
+    while (_slots[next].index != EmptySlot) {
+        const size_t ideal = _slots[next].hash & mask;
+        // Move the entry if its ideal position is not in ]pos, next]
+        if (((next - ideal) & mask) >= ((next - pos) & mask)) {
+            _slots[pos] = _slots[next];
+            pos = next;
+        }
+        next = (next + 1) & mask;
+    }
+    _slots[pos].index = EmptySlot;
+
+    if (_size == 0) {
+        _paths.clear();
+    }
+    return true;
+}
+
+bool Selection::Contains(const SdfPath &path) const {
+    if (_size == 0)
+        return false;
+    const size_t hash = MixPathHash(SdfPath::Hash{}(path));
+    return _slots[FindSlot(path, hash)].index != EmptySlot;
+}
+
+bool Selection::HasSelectedDescendant(const SdfPath &path) const {
+    const auto it = _selectedDescendants.find(path);
+    return it != _selectedDescendants.end() && it->second > 0;
 }
 
-bool IsSelected(const Selection &selection, const SdfPath &path) {
-    if (selection) {
-        if (selection->GetPrimSelectionState(HdSelection::HighlightModeSelect, path)) {
+bool Selection::IsAncestorSelected(const SdfPath &path) const {
+    if (_size == 0)
+        return false;
+    for (SdfPath ancestor = path.GetParentPath(); !ancestor.IsEmpty(); ancestor = ancestor.GetParentPath()) {
+        if (Contains(ancestor)) {
             return true;
         }
     }
     return false;
 }
 
-bool IsSelectionEmpty(const Selection &selection) { return !selection || selection->IsEmpty(); }
+SdfPath Selection::GetFirstPath() const {
+    for (const auto &path : _paths) {
+        if (!path.IsEmpty()) {
+            return path;
+        }
+    }
+    return {};
+}
+
+std::vector<SdfPath> Selection::GetPaths() const {
+    std::vector<SdfPath> paths;
+    paths.reserve(_size);
+    ForEach([&](const SdfPath &path) { paths.push_back(path); });
+    return paths;
+}
+
+/// Clear selection, editor implementation
+void ClearSelection(Selection &selection) { selection.Clear(); }
+
+void AddSelection(Selection &selection, const SdfPath &path) { selection.Add(path); }
+
+void SetSelected(Selection &selection, const SdfPath &path) {
+    // Avoid changing the generation when the same path is selected again
+    if (selection.Size() == 1 && selection.Contains(path))
+        return;
+    selection.Clear();
+    selection.Add(path);
+}
+
+bool IsSelected(const Selection &selection, const SdfPath &path) { return selection.Contains(path); }
+
+bool IsSelectionEmpty(const Selection &selection) { return selection.IsEmpty(); }
 
 bool UpdateSelectionHash(const Selection &selection, SelectionHash &lastSelectionHash) {
-    if (GetSelectionHash(selection) != lastSelectionHash) {
-        lastSelectionHash = GetSelectionHash(selection);
+    if (selection.GetHash() != lastSelectionHash) {
+        lastSelectionHash = selection.GetHash();
         return true;
     }
     return false;
 }
 
+bool HasSelectedDescendant(const Selection &selection, const SdfPath &path) { return selection.HasSelectedDescendant(path); }
 
+bool IsAncestorSelected(const Selection &selection, const SdfPath &path) { return selection.IsAncestorSelected(path); }
 
-SdfPath GetSelectedPath(const Selection &selection) {
-    if (selection) {
-        const auto &paths = selection->GetSelectedPrimPaths(HdSelection::HighlightModeSelect);
-        if (!paths.empty()) {
-            return paths[0];
-        }
-    }
-    return {};
+uint64_t GetSelectionGeneration(const Selection &selection) { return selection.GetGeneration(); }
+
+bool GetSelectionChanges(const Selection &selection, uint64_t sinceGeneration, std::vector<SdfPath> &added,
+                         std::vector<SdfPath> &removed) {
+    return selection.GetChanges(sinceGeneration, added, removed);
 }
 
-std::vector<SdfPath> GetSelectedPaths(const Selection &selection) {
-    if (selection) {
-        return selection->GetAllSelectedPrimPaths();
-    }
-    return {};
+SdfPath GetSelectedPath(const Selection &selection) { return selection.GetFirstPath(); }
+
+std::vector<SdfPath> GetSelectedPaths(const Selection &selection) { return selection.GetPaths(); }
+
+HdSelectionSharedPtr GetHdSelection(const Selection &selection) {
+    auto hdSelection = std::make_shared<HdSelection>();
+    selection.ForEach([&](const SdfPath &path) { hdSelection->AddRprim(HdSelection::HighlightModeSelect, path); });
+    return hdSelection;
 }
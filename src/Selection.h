@@ -1,6 +1,9 @@
 #pragma once
-#include <memory>
+#include <cstdint>
+#include <vector>
 #include <pxr/usd/sdf/path.h>
+#include <pxr/usd/sdf/pathTable.h>
+#include <pxr/imaging/hd/selection.h>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -8,12 +11,94 @@ PXR_NAMESPACE_USING_DIRECTIVE
 /// Selection api used by the widgets and the editor
 ///
 
-/// At the moment we use a HdSelection, but this will change as the we want to store additional states
-/// The selection implementation will move outside this header
-#include <pxr/imaging/hd/selection.h>
-using Selection = std::unique_ptr<HdSelection>;
 using SelectionHash = std::size_t;
 
+///
+/// Set of selected paths. The paths are stored in an open addressing hash table, indexing the paths kept
+/// in their selection order, so the membership test is O(1) and doesn't depend on the number of selected paths.
+/// The hash of the selection doesn't depend on the order of the paths and is updated at each insertion/removal,
+/// the generation changes each time the selection is modified.
+/// The additions and removals are kept in a log, so the clients can update only what changed since the
+/// last generation they've seen.
+/// The number of selected descendants of each ancestor of the selected paths is maintained in a path table, so the
+/// hierarchical queries are O(depth).
+///
+class Selection {
+  public:
+    Selection() = default;
+
+    void Clear();
+    /// Add the path, returns false if it was already selected
+    bool Add(const SdfPath &path);
+    /// Remove the path, returns false if it wasn't selected
+    bool Remove(const SdfPath &path);
+
+    bool Contains(const SdfPath &path) const;
+
+    /// Returns true if a path under path, excluding path, is selected
+    bool HasSelectedDescendant(const SdfPath &path) const;
+
+    /// Returns true if an ancestor of path, excluding path, is selected
+    bool IsAncestorSelected(const SdfPath &path) const;
+    bool IsEmpty() const { return _size == 0; }
+    size_t Size() const { return _size; }
+
+    /// Order independent hash of the selected paths, 0 when empty
+    SelectionHash GetHash() const { return _hash; }
+
+    /// Incremented each time the selection is modified
+    uint64_t GetGeneration() const { return _generation; }
+
+    /// First path of the selection in selection order, an empty path if there is none
+    SdfPath GetFirstPath() const;
+
+    /// Selected paths in selection order
+    std::vector<SdfPath> GetPaths() const;
+
+    /// Paths added and removed since the generation sinceGeneration, in modification order.
+    /// Returns false if the log doesn't go back that far, the selection was cleared for example, and the client
+    /// has to read the whole selection.
+    bool GetChanges(uint64_t sinceGeneration, std::vector<SdfPath> &added, std::vector<SdfPath> &removed) const;
+
+    /// Call func on each selected path, in selection order
+    template <typename FuncT> void ForEach(FuncT &&func) const {
+        for (const auto &path : _paths) {
+            if (!path.IsEmpty()) {
+                func(path);
+            }
+        }
+    }
+
+  private:
+    struct Slot {
+        size_t hash;
+        uint32_t index; // Index in _paths, EmptySlot if the slot is free
+    };
+    static constexpr uint32_t EmptySlot = UINT32_MAX;
+
+    size_t FindSlot(const SdfPath &path, size_t hash) const;
+    void Rehash(size_t capacity);
+    void Compact();
+    void LogChange(const SdfPath &path, bool added);
+    void AddToAncestors(const SdfPath &path);
+    void RemoveFromAncestors(const SdfPath &path);
+
+    std::vector<Slot> _slots;     // Power of 2 size, linear probing
+    std::vector<SdfPath> _paths;  // Selection order, removed paths are left empty until the next compaction
+    size_t _size = 0;             // Number of selected paths
+    SelectionHash _hash = 0;
+    uint64_t _generation = 0;
+    SdfPathTable<size_t> _selectedDescendants; // Number of selected paths under each ancestor
+
+    struct Change {
+        uint64_t generation;
+        SdfPath path;
+        bool added;
+    };
+    std::vector<Change> _changes; // Modifications after _changesStart, ordered by generation
+    uint64_t _changesStart = 0;
+};
+
 /// Functions to modify the selection, they will have different implementation depending on if they
 /// are used in the editor (with the command system) or outside by a client which already has a selection
 /// mechanism / implementation
@@ -29,11 +114,22 @@ bool IsSelectionEmpty(const Selection &selection);
 /// meaning the selection has changed.
 bool UpdateSelectionHash(const Selection &selection, SelectionHash &lastSelectionHash);
 
-/// Returns a unique identifier for this selection
-//SelectionHash GetSelectionHash(const Selection &selection);
+/// Hierarchical queries, see Selection
+bool HasSelectedDescendant(const Selection &selection, const SdfPath &path);
+bool IsAncestorSelected(const Selection &selection, const SdfPath &path);
+
+/// Returns the current generation of the selection
+uint64_t GetSelectionGeneration(const Selection &selection);
 
-/// Returns the last selected path
+/// Returns false if the changes since the generation sinceGeneration are not known, the whole selection must be read
+bool GetSelectionChanges(const Selection &selection, uint64_t sinceGeneration, std::vector<SdfPath> &added,
+                         std::vector<SdfPath> &removed);
+
+/// Returns the first selected path
 SdfPath GetSelectedPath(const Selection &selection);
 
 /// Returns all the selected path
 std::vector<SdfPath> GetSelectedPaths(const Selection &selection);
+
+/// Returns the selection as an HdSelection, only when hydra needs it
+HdSelectionSharedPtr GetHdSelection(const Selection &selection);
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include "SublayerCache.h"
+
+/// Delays between the attempts to open a missing sublayer, doubled after each attempt
+static constexpr std::chrono::seconds FirstRetryDelay(1);
+static constexpr std::chrono::seconds MaxRetryDelay(60);
+
+SublayerCache::SublayerCache() {
+    _noticeKey = TfNotice::Register(TfCreateWeakPtr(this), &SublayerCache::OnLayersDidChange);
+}
+
+SublayerCache::~SublayerCache() {
+    TfNotice::Revoke(_noticeKey);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopWorker = true;
+    }
+    _wakeUp.notify_one();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+SublayerCache::Status SublayerCache::Get(const SdfLayerHandle &layer, const std::string &subLayerPath,
+                                         SdfLayerRefPtr &subLayer) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto inserted = _entries.emplace(Key(layer, subLayerPath), Entry());
+    Entry &entry = inserted.first->second;
+    if (inserted.second) {
+        entry.generation = ++_generation;
+    }
+    // The worker gets a reference to the layer taken here, where the layer is known to be alive
+    const bool mustOpen =
+        inserted.second || (entry.status == Status::Missing && !entry.layer && entry.nextAttempt <= Clock::now());
+    if (mustOpen) {
+        entry.layer = SdfLayerRefPtr(layer);
+    }
+    subLayer = entry.subLayer;
+    const Status status = entry.status;
+    lock.unlock();
+    if (mustOpen) {
+        StartWorker();
+        _wakeUp.notify_one();
+    }
+    return status;
+}
+
+void SublayerCache::Retry(const SdfLayerHandle &layer, const std::string &subLayerPath) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(Key(layer, subLayerPath));
+        if (it == _entries.end() || it->second.status != Status::Missing || it->second.layer) {
+            return;
+        }
+        it->second.layer = SdfLayerRefPtr(layer);
+    }
+    StartWorker();
+    _wakeUp.notify_one();
+}
+
+void SublayerCache::Prune() {
+    std::vector<SdfLayerRefPtr> releasedLayers; // Destroyed after the lock, it might hold the last references
+    std::lock_guard<std::mutex> lock(_mutex);
+    EraseReleasedLayers(releasedLayers);
+}
+
+void SublayerCache::OnLayersDidChange(const SdfNotice::LayersDidChange &notice) {
+    for (const auto &layerChanges : notice.GetChangeListVec()) {
+        const SdfChangeList &changeList = layerChanges.second;
+        bool invalidate = !changeList.GetSubLayerChanges().empty();
+        // The relative sublayer paths are anchored to the layer
+        for (const auto &entry : changeList.GetEntryList()) {
+            if (entry.first.IsAbsoluteRootPath()) {
+                const auto &flags = entry.second.flags;
+                invalidate = invalidate || flags.didReloadContent || flags.didReplaceContent || flags.didChangeIdentifier ||
+                             flags.didChangeResolvedPath;
+            }
+        }
+        if (invalidate) {
+            Invalidate(layerChanges.first);
+        }
+    }
+}
+
+void SublayerCache::Invalidate(const SdfLayerHandle &layer) {
+    std::vector<SdfLayerRefPtr> releasedLayers; // Destroyed after the lock, it might hold the last references
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.lower_bound(Key(layer, std::string()));
+    while (it != _entries.end() && it->first.first == layer) {
+        releasedLayers.push_back(std::move(it->second.subLayer));
+        it = _entries.erase(it);
+    }
+    EraseReleasedLayers(releasedLayers);
+}
+
+/// Erase the entries of the released layers, called with the mutex held. Their sublayers are moved to subLayers,
+/// to be released by the caller after unlocking the mutex. The entries of the sublayers released this way are erased
+/// at the next call
+void SublayerCache::EraseReleasedLayers(std::vector<SdfLayerRefPtr> &subLayers) {
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it->first.first) {
+            ++it;
+        } else {
+            subLayers.push_back(std::move(it->second.subLayer));
+            it = _entries.erase(it);
+        }
+    }
+}
+
+void SublayerCache::StartWorker() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_worker.joinable()) {
+        _worker = std::thread(&SublayerCache::Work, this);
+    }
+}
+
+void SublayerCache::Work() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopWorker) {
+        // Next entry to open: a new entry or a new attempt on a missing one
+        auto next = std::find_if(_entries.begin(), _entries.end(), [](const std::pair<const Key, Entry> &keyEntry) {
+            return static_cast<bool>(keyEntry.second.layer);
+        });
+        if (next == _entries.end()) {
+            _wakeUp.wait(lock);
+            continue;
+        }
+
+        const Key key = next->first;
+        const size_t generation = next->second.generation;
+        SdfLayerRefPtr layer = std::move(next->second.layer);
+        next->second.layer = SdfLayerRefPtr();
+        lock.unlock();
+        SdfLayerRefPtr subLayer = SdfLayer::FindOrOpenRelativeToLayer(layer, key.second);
+        lock.lock();
+
+        auto it = _entries.find(key);
+        if (it != _entries.end() && it->second.generation == generation) {
+            Entry &entry = it->second;
+            entry.numAttempts++;
+            if (subLayer) {
+                entry.status = Status::Found;
+                entry.subLayer = subLayer;
+            } else {
+                entry.status = Status::Missing;
+                const auto delay = std::min<std::chrono::seconds>(FirstRetryDelay * (1 << std::min(entry.numAttempts - 1, 6)),
+                                                                   MaxRetryDelay);
+                entry.nextAttempt = Clock::now() + delay;
+            }
+        }
+        // The ui might have released the layers while they were opened, the last references are dropped unlocked
+        lock.unlock();
+        layer.Reset();
+        subLayer.Reset();
+        lock.lock();
+    }
+}
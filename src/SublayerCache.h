@@ -0,0 +1,72 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/notice.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// Sublayers of the layers, resolved and opened in the background.
+///
+/// Opening a sublayer can hit the resolver, the network or the file system, so the ui never opens them. A sublayer
+/// path is resolved once on a worker thread and kept until the sublayers of its layer change. The missing sublayers
+/// are tried again with an increasing delay when they are asked for, they might be created or become reachable later.
+/// The cache doesn't keep the layers alive: the sublayers found are kept open only while their layer exists, the
+/// entries of the released layers are erased by Prune, once per frame, and when a layer is invalidated.
+///
+class SublayerCache final : public TfWeakBase {
+  public:
+    enum class Status { Pending, Found, Missing };
+
+    SublayerCache();
+    ~SublayerCache();
+
+    // Delete copy
+    SublayerCache(const SublayerCache &) = delete;
+    SublayerCache &operator=(const SublayerCache &) = delete;
+
+    /// Sublayer subLayerPath of layer as resolved by the worker. The first call queues the resolution, and the calls
+    /// after the retry delay of a missing sublayer queue a new attempt
+    Status Get(const SdfLayerHandle &layer, const std::string &subLayerPath, SdfLayerRefPtr &subLayer);
+
+    /// Try again to open a missing sublayer without waiting for the next attempt
+    void Retry(const SdfLayerHandle &layer, const std::string &subLayerPath);
+
+    /// Erase the entries of the released layers and close their sublayers. It goes through all the entries, call it
+    /// once per frame, not per lookup
+    void Prune();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+    using Key = std::pair<SdfLayerHandle, std::string>;
+    struct Entry {
+        Status status = Status::Pending;
+        SdfLayerRefPtr layer;    // Set by the ui thread when the sublayer must be opened, released by the worker
+        SdfLayerRefPtr subLayer; // Kept open while the entry exists
+        int numAttempts = 0;
+        Clock::time_point nextAttempt;
+        size_t generation = 0; // A result is dropped if the entry was replaced while the worker was opening it
+    };
+
+    void OnLayersDidChange(const SdfNotice::LayersDidChange &notice);
+    void Invalidate(const SdfLayerHandle &layer);
+    void EraseReleasedLayers(std::vector<SdfLayerRefPtr> &subLayers);
+    void StartWorker();
+    void Work();
+
+    std::mutex _mutex; // Protects the entries
+    std::condition_variable _wakeUp;
+    std::map<Key, Entry> _entries;
+    size_t _generation = 0;
+    std::thread _worker;
+    bool _stopWorker = false;
+    TfNotice::Key _noticeKey;
+};
@@ -0,0 +1,343 @@
+///
+/// Micro benchmarks of the undo/redo recording pipeline: SdfUndoRecorder + UndoRedoLayerStateDelegate
+/// for the recording, SdfCommandGroup::DoIt/UndoIt for the replay.
+///
+/// The memory reported is the memory held by the recorded instructions: the bytes released when the
+/// command group is cleared, so buffers shared with the layer are not counted.
+///
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <benchmark/benchmark.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/usd/sdf/attributeSpec.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/sdf/schema.h>
+#include <pxr/usd/sdf/types.h>
+#include "SdfCommandGroup.h"
+#include "SdfUndoRecorder.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// Allocation tracking: every allocation stores its size in a header so the live bytes can be followed
+///
+static std::atomic<std::int64_t> liveBytes{0};
+constexpr std::size_t AllocationHeaderSize = alignof(std::max_align_t);
+
+void *operator new(std::size_t size) {
+    void *block = std::malloc(size + AllocationHeaderSize);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    *static_cast<std::size_t *>(block) = size;
+    liveBytes += static_cast<std::int64_t>(size);
+    return static_cast<char *>(block) + AllocationHeaderSize;
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr) {
+        char *block = static_cast<char *>(ptr) - AllocationHeaderSize;
+        liveBytes -= static_cast<std::int64_t>(*reinterpret_cast<std::size_t *>(block));
+        std::free(block);
+    }
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+/// Clears the command group and returns the number of bytes it was holding
+static std::int64_t ReleaseCommandGroup(SdfCommandGroup &commands) {
+    const std::int64_t before = liveBytes;
+    commands.Clear();
+    return before - liveBytes;
+}
+
+/// Publish the memory counters on the benchmark state
+static void SetMemoryCounters(benchmark::State &state, std::int64_t releasedBytes, std::int64_t numInstructions) {
+    state.counters["instructions"] = benchmark::Counter(static_cast<double>(numInstructions), benchmark::Counter::kAvgIterations);
+    state.counters["bytes_per_instruction"] =
+        numInstructions ? static_cast<double>(releasedBytes) / static_cast<double>(numInstructions) : 0.0;
+}
+
+///
+/// Test layer helpers
+///
+static SdfLayerRefPtr CreateTestLayer() { return SdfLayer::CreateAnonymous("benchmark.usda"); }
+
+static SdfAttributeSpecHandle CreateTestAttribute(SdfLayerRefPtr layer, const SdfValueTypeName &typeName) {
+    SdfPrimSpecHandle prim = SdfPrimSpec::New(layer, "prim", SdfSpecifierDef, "Mesh");
+    return SdfAttributeSpec::New(prim, "attribute", typeName);
+}
+
+/// Creates a flat subtree with numPrims children, each with one attribute holding a default value
+static SdfPrimSpecHandle CreateSubtree(SdfLayerRefPtr layer, const std::string &rootName, int numPrims) {
+    SdfChangeBlock block;
+    SdfPrimSpecHandle root = SdfPrimSpec::New(layer, rootName, SdfSpecifierDef, "Xform");
+    for (int i = 0; i < numPrims; ++i) {
+        SdfPrimSpecHandle child = SdfPrimSpec::New(root, "child" + std::to_string(i), SdfSpecifierDef, "Xform");
+        SdfAttributeSpecHandle attribute = SdfAttributeSpec::New(child, "value", SdfValueTypeNames->Double);
+        attribute->SetDefaultValue(VtValue(static_cast<double>(i)));
+    }
+    return root;
+}
+
+static VtArray<GfVec3f> CreatePoints(size_t numPoints, float value) { return VtArray<GfVec3f>(numPoints, GfVec3f(value)); }
+
+///
+/// Recording benchmarks
+///
+
+/// Set a scalar default value, range(0) times in the same command
+static void BM_RecordSetFieldScalar(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Double)->GetPath();
+    const int numEdits = static_cast<int>(state.range(0));
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    for (auto _ : state) {
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            for (int i = 0; i < numEdits; ++i) {
+                layer->SetField(path, SdfFieldKeys->Default, VtValue(static_cast<double>(i)));
+            }
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * numEdits);
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordSetFieldScalar)->Arg(1)->Arg(64)->Arg(4096);
+
+/// Set a 1M points array with a VtValue, alternating between two arrays
+static void BM_RecordSetFieldArrayVtValue(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Point3fArray)->GetPath();
+    const VtValue points[2] = {VtValue(CreatePoints(state.range(0), 0.f)), VtValue(CreatePoints(state.range(0), 1.f))};
+    layer->SetField(path, SdfFieldKeys->Default, points[1]);
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    int edit = 0;
+    for (auto _ : state) {
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            layer->SetField(path, SdfFieldKeys->Default, points[edit++ % 2]);
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        state.ResumeTiming();
+    }
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordSetFieldArrayVtValue)->Arg(1 << 20);
+
+/// Set a 1M points array through the typed api, which goes through SdfAbstractDataConstValue
+static void BM_RecordSetFieldArrayTyped(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Point3fArray)->GetPath();
+    const VtArray<GfVec3f> points[2] = {CreatePoints(state.range(0), 0.f), CreatePoints(state.range(0), 1.f)};
+    layer->SetField(path, SdfFieldKeys->Default, points[1]);
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    int edit = 0;
+    for (auto _ : state) {
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            layer->SetField(path, SdfFieldKeys->Default, points[edit++ % 2]);
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        state.ResumeTiming();
+    }
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordSetFieldArrayTyped)->Arg(1 << 20);
+
+/// Burst of time samples on one attribute in the same command, like a key bake
+static void BM_RecordSetTimeSampleBurst(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Double)->GetPath();
+    const int numSamples = static_cast<int>(state.range(0));
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    for (auto _ : state) {
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            for (int frame = 0; frame < numSamples; ++frame) {
+                layer->SetTimeSample(path, static_cast<double>(frame), VtValue(static_cast<double>(frame)));
+            }
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        layer->EraseField(path, SdfFieldKeys->TimeSamples);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * numSamples);
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordSetTimeSampleBurst)->Arg(16)->Arg(1024)->Arg(10000);
+
+/// Creation of a subtree of range(0) prims
+static void BM_RecordCreateSpecSubtree(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const int numPrims = static_cast<int>(state.range(0));
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    for (auto _ : state) {
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            CreateSubtree(layer, "tree", numPrims);
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        layer->RemoveRootPrim(layer->GetPrimAtPath(SdfPath("/tree")));
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * numPrims);
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordCreateSpecSubtree)->Arg(1000)->Arg(10000);
+
+/// Deletion of a subtree of range(0) prims, the delegate copies the whole subtree
+static void BM_RecordDeleteSpecSubtree(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const int numPrims = static_cast<int>(state.range(0));
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        SdfPrimSpecHandle root = CreateSubtree(layer, "tree", numPrims);
+        state.ResumeTiming();
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            layer->RemoveRootPrim(root);
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * numPrims);
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordDeleteSpecSubtree)->Arg(1000)->Arg(10000);
+
+/// Rename of the root of a subtree of range(0) prims
+static void BM_RecordMoveSpec(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    SdfPrimSpecHandle root = CreateSubtree(layer, "tree", static_cast<int>(state.range(0)));
+    const std::string names[2] = {"moved", "tree"};
+    SdfCommandGroup commands;
+    std::int64_t releasedBytes = 0;
+    std::int64_t numInstructions = 0;
+    int edit = 0;
+    for (auto _ : state) {
+        {
+            SdfUndoRecorder recorder(commands, layer);
+            root->SetName(names[edit++ % 2]);
+        }
+        state.PauseTiming();
+        numInstructions += commands.GetNumInstructions();
+        releasedBytes += ReleaseCommandGroup(commands);
+        state.ResumeTiming();
+    }
+    SetMemoryCounters(state, releasedBytes, numInstructions);
+}
+BENCHMARK(BM_RecordMoveSpec)->Arg(1000)->Arg(10000);
+
+///
+/// Replay benchmarks, an iteration is an UndoIt followed by a DoIt
+///
+
+template <typename RecordFuncT> static void ReplayCommands(benchmark::State &state, SdfLayerRefPtr layer, RecordFuncT record) {
+    SdfCommandGroup commands;
+    {
+        SdfUndoRecorder recorder(commands, layer);
+        record();
+    }
+    for (auto _ : state) {
+        commands.UndoIt();
+        commands.DoIt();
+    }
+    state.counters["instructions"] = static_cast<double>(commands.GetNumInstructions());
+}
+
+static void BM_ReplaySetFieldScalar(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Double)->GetPath();
+    const int numEdits = static_cast<int>(state.range(0));
+    ReplayCommands(state, layer, [&]() {
+        for (int i = 0; i < numEdits; ++i) {
+            layer->SetField(path, SdfFieldKeys->Default, VtValue(static_cast<double>(i)));
+        }
+    });
+    state.SetItemsProcessed(state.iterations() * numEdits);
+}
+BENCHMARK(BM_ReplaySetFieldScalar)->Arg(64)->Arg(4096);
+
+static void BM_ReplaySetFieldArray(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Point3fArray)->GetPath();
+    layer->SetField(path, SdfFieldKeys->Default, CreatePoints(state.range(0), 0.f));
+    const VtArray<GfVec3f> points = CreatePoints(state.range(0), 1.f);
+    ReplayCommands(state, layer, [&]() { layer->SetField(path, SdfFieldKeys->Default, points); });
+}
+BENCHMARK(BM_ReplaySetFieldArray)->Arg(1 << 20);
+
+static void BM_ReplaySetTimeSampleBurst(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const SdfPath path = CreateTestAttribute(layer, SdfValueTypeNames->Double)->GetPath();
+    const int numSamples = static_cast<int>(state.range(0));
+    ReplayCommands(state, layer, [&]() {
+        for (int frame = 0; frame < numSamples; ++frame) {
+            layer->SetTimeSample(path, static_cast<double>(frame), VtValue(static_cast<double>(frame)));
+        }
+    });
+    state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK(BM_ReplaySetTimeSampleBurst)->Arg(16)->Arg(1024)->Arg(10000);
+
+static void BM_ReplayCreateSpecSubtree(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const int numPrims = static_cast<int>(state.range(0));
+    ReplayCommands(state, layer, [&]() { CreateSubtree(layer, "tree", numPrims); });
+    state.SetItemsProcessed(state.iterations() * numPrims);
+}
+BENCHMARK(BM_ReplayCreateSpecSubtree)->Arg(1000)->Arg(10000);
+
+static void BM_ReplayDeleteSpecSubtree(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    const int numPrims = static_cast<int>(state.range(0));
+    SdfPrimSpecHandle root = CreateSubtree(layer, "tree", numPrims);
+    ReplayCommands(state, layer, [&]() { layer->RemoveRootPrim(root); });
+    state.SetItemsProcessed(state.iterations() * numPrims);
+}
+BENCHMARK(BM_ReplayDeleteSpecSubtree)->Arg(1000)->Arg(10000);
+
+static void BM_ReplayMoveSpec(benchmark::State &state) {
+    auto layer = CreateTestLayer();
+    SdfPrimSpecHandle root = CreateSubtree(layer, "tree", static_cast<int>(state.range(0)));
+    ReplayCommands(state, layer, [&]() { root->SetName("moved"); });
+}
+BENCHMARK(BM_ReplayMoveSpec)->Arg(1000)->Arg(10000);
+
+BENCHMARK_MAIN();
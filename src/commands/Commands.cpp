@@ -1,9 +1,14 @@
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include "Commands.h"
 #include "SdfCommandGroup.h"
 #include "SdfUndoRecorder.h"
 #include "UndoLayerStateDelegate.h"
+#include "EditJournal.h"
 
 /// Base class for all commands.
 /// As we expect to store lots of commands, it might be worth avoiding
@@ -61,14 +66,22 @@ static int undoStackPos = 0;
 // Storing only one command per frame for now, easier to reason about.
 static Command *lastCmd = nullptr;
 
+// The deferred calls of the USD api are constructed in a static storage instead of being allocated.
+// As for lastCmd, only one call is waiting at a time.
+static std::aligned_storage<DeferredCallStorageSize, alignof(std::max_align_t)>::type deferredCallStorage;
+static DeferredCallBase *deferredCall = nullptr;
 
 /// Dispatching a command from the software will create a command but not Run it.
 template <typename CommandClass, typename... ArgTypes> void ExecuteAfterDraw(ArgTypes... arguments) {
-    if (!lastCmd) {
+    if (!lastCmd && !deferredCall) {
         lastCmd = new CommandClass(arguments...);
     }
 }
 
+void *AcquireDeferredCallStorage() { return lastCmd || deferredCall ? nullptr : &deferredCallStorage; }
+
+void PostDeferredCall(DeferredCallBase *call) { deferredCall = call; }
+
 /// The ProcessCommands function is called after the frame is rendered and displayed and execute the
 /// last command.
 static void _PushCommand(Command *cmd) {
@@ -77,9 +90,67 @@ static void _PushCommand(Command *cmd) {
     }
     undoStack.emplace_back(std::move(cmd));
     undoStackPos++;
+    JournalCommit();
+}
+
+static std::shared_timed_mutex stageEditMutex;
+static std::atomic<uint64_t> stageEditEpoch(0);
+static int stageEditLockDepth = 0;
+
+void LockStageEdits() {
+    if (stageEditLockDepth++ == 0) {
+        // The epoch changes before waiting for the lock, so the background readers stop at the end of their batch
+        stageEditEpoch++;
+        stageEditMutex.lock();
+    }
+}
+
+void UnlockStageEdits() {
+    if (stageEditLockDepth > 0 && --stageEditLockDepth == 0) {
+        stageEditMutex.unlock();
+    }
+}
+
+std::shared_timed_mutex &GetStageEditMutex() { return stageEditMutex; }
+
+uint64_t GetStageEditEpoch() { return stageEditEpoch; }
+
+bool IsStageEditLocked() { return stageEditLockDepth > 0; }
+
+bool LockStageEditsShared(std::shared_lock<std::shared_timed_mutex> &lock, const std::atomic<bool> &cancelled) {
+    while (!lock.try_lock()) {
+        if (cancelled) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void ExecuteAndRecord(SdfLayerRefPtr layer, const std::function<void()> &func) {
+    SdfUndoRedoCommand *command = new SdfUndoRedoCommand();
+    {
+        LockStageEdits();
+        SdfUndoRecorder recorder(command->_instructions, layer);
+        func();
+        UnlockStageEdits();
+    }
+    if (command->_instructions.IsEmpty()) {
+        delete command; // Nothing was changed, the object might not exist anymore
+    } else {
+        _PushCommand(command);
+    }
 }
 
 void ExecuteCommands() {
+    if (!deferredCall && !lastCmd)
+        return;
+    LockStageEdits();
+    if (deferredCall) {
+        ExecuteAndRecord(deferredCall->GetLayer(), [&]() { deferredCall->Call(); });
+        deferredCall->~DeferredCallBase();
+        deferredCall = nullptr;
+    }
     if (lastCmd) {
         if (lastCmd->DoIt()) {
             _PushCommand(lastCmd);
@@ -89,6 +160,7 @@ void ExecuteCommands() {
         }
        lastCmd = nullptr;   // Reset the command
     }
+    UnlockStageEdits();
 }
 
 /// A SdfUndoRedoRecorder creates an object on the stack which will start recording all the usd commands
@@ -97,13 +169,11 @@ class SdfUndoRedoRecorder final {
 public:
 
     SdfUndoRedoRecorder(SdfLayerRefPtr layer)
-        : _editedCommand(nullptr), _layer(layer) {
+        : _editedCommand(nullptr), _layer(layer), _previousCommands(nullptr), _recording(false) {
     }
 
     ~SdfUndoRedoRecorder() {
-        if (_layer && _previousDelegate) {
-            _layer->SetStateDelegate(_previousDelegate);
-        }
+        StopRecording();
         if (_editedCommand){
             _PushCommand(_editedCommand);
             _editedCommand = nullptr;
@@ -111,26 +181,30 @@ public:
     }
 
     void StartRecording() {
-        if (_layer){
-            _previousDelegate = _layer->GetStateDelegate();
+        if (_layer && !_recording){
             if (!_editedCommand) {
                 _editedCommand = new SdfUndoRedoCommand();
             }
-            // Install undo/redo delegate
-            _layer->SetStateDelegate(UndoRedoLayerStateDelegate::New(_editedCommand->_instructions));
+            // The delegate is normally already there, it is installed when the stage or layer is opened
+            InstallUndoRedoDelegate(_layer);
+            _previousCommands = GetRecordingCommandGroup();
+            SetRecordingCommandGroup(&_editedCommand->_instructions);
+            _recording = true;
         }
     }
 
     void StopRecording() {
-        if (_layer && _previousDelegate){
-            _layer->SetStateDelegate(_previousDelegate);
+        if (_recording){
+            SetRecordingCommandGroup(_previousCommands);
+            _recording = false;
         }
     }
 
 private:
     SdfUndoRedoCommand  *_editedCommand;
     SdfLayerRefPtr _layer;
-    SdfLayerStateDelegateBaseRefPtr _previousDelegate;
+    SdfCommandGroup *_previousCommands;
+    bool _recording;
 };
 
 SdfUndoRedoRecorder *undoRedoRecorder = nullptr;
@@ -147,6 +221,9 @@ void BeginEdition(UsdStageRefPtr stage) {
 void BeginEdition(SdfLayerRefPtr layer) {
     if (layer) {
         // TODO: check there is no undoRedoRecorder alive
+        if (!undoRedoRecorder) {
+            LockStageEdits();
+        }
         undoRedoRecorder = new SdfUndoRedoRecorder(layer);
         undoRedoRecorder->StartRecording();
     }
@@ -157,6 +234,7 @@ void EndEdition() {
         undoRedoRecorder->StopRecording();
         delete undoRedoRecorder;
         undoRedoRecorder = nullptr;
+        UnlockStageEdits();
     }
 }
 
@@ -6,8 +6,16 @@
 #include <pxr/usd/usdGeom/gprim.h>
 #include <pxr/usd/usdGeom/xformCommonAPI.h>
 #include <pxr/usd/usdGeom/camera.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <new>
+#include <shared_mutex>
+#include <string>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -33,6 +41,10 @@ struct EditorSetEditTarget;
 struct EditorSetCurrentLayer;
 struct EditorSetPreviousLayer;
 struct EditorSetNextLayer;
+struct EditorLoadPayload;
+struct EditorUnloadPayload;
+struct EditorCommitPayloads;
+struct EditorShowLayerDiff;
 
 struct LayerRemoveSubLayer;
 struct LayerMoveSubLayer;
@@ -51,169 +63,158 @@ struct UsdFunctionCall;
 /// The commands are defined in Commands.cpp and its included file
 template <typename CommandClass, typename... ArgTypes> void ExecuteAfterDraw(ArgTypes... arguments);
 
+///
 /// Convenience functions to avoid creating commands and directly call the USD api after the editor frame is rendered.
 /// It will also record the changes made on the layer by the function and store a command in the undo/redo.
-template <typename FuncT, typename... ArgsT> void ExecuteAfterDraw(FuncT &&func, SdfLayerRefPtr layer, ArgsT &&...arguments) {
-    std::function<void()> usdApiFunc = std::bind(func, layer, std::forward<ArgsT>(arguments)...);
-    ExecuteAfterDraw<UsdFunctionCall>(layer, usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT> void ExecuteAfterDraw(FuncT &&func, UsdStageRefPtr stage, ArgsT &&...arguments) {
-    std::function<void()> usdApiFunc = std::bind(func, stage, std::forward<ArgsT>(arguments)...);
-    auto layer = TfCreateRefPtrFromProtectedWeakPtr(stage->GetEditTarget().GetLayer());
-    ExecuteAfterDraw<UsdFunctionCall>(layer, usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT> void ExecuteAfterDraw(FuncT &&func, SdfPrimSpecHandle handle, ArgsT &&...arguments) {
-    // Some kind of trickery to recover the SdfPrimSpecHandle at the time of the call.
-    // We store its path and layer in a lambda function
-    const auto &path = handle->GetPath();
-    SdfLayerRefPtr layer = handle->GetLayer();
-    std::function<void()> usdApiFunc = [=]() {
-        auto primSpec = layer->GetPrimAtPath(path);
-        std::function<void()> primSpecFunc = std::bind(func, get_pointer(primSpec), arguments...);
-        primSpecFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(layer, usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT> void ExecuteAfterDraw(FuncT &&func, const UsdPrim &prim, ArgsT &&...arguments) {
-    const auto &path = prim.GetPath();
-    UsdStageWeakPtr stage = prim.GetStage();
-    std::function<void()> usdApiFunc = [=]() {
-        auto prim = stage->GetPrimAtPath(path);
-        std::function<void()> primFunc = std::bind(func, &prim, arguments...);
-        primFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(stage->GetEditTarget().GetLayer(), usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, const UsdAttribute &attribute, ArgsT &&...arguments) {
-    const auto &path = attribute.GetPath();
-    UsdStageWeakPtr stage = attribute.GetStage();
-    std::function<void()> usdApiFunc = [=]() {
-        auto att = stage->GetAttributeAtPath(path);
-        std::function<void()> attributeFunc = std::bind(func, &att, arguments...);
-        attributeFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(stage->GetEditTarget().GetLayer(), usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, const UsdRelationship &relationship, ArgsT &&...arguments) {
-    const auto &path = relationship.GetPath();
-    UsdStageWeakPtr stage = relationship.GetStage();
-    std::function<void()> usdApiFunc = [=]() {
-        auto relationship = stage->GetRelationshipAtPath(path);
-        std::function<void()> relationshipFunc = std::bind(func, &relationship, arguments...);
-        relationshipFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(stage->GetEditTarget().GetLayer(), usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, const UsdVariantSet &variantSet, ArgsT &&...arguments) {
-    const auto &prim = variantSet.GetPrim();
-    const auto &variantName = variantSet.GetName();
-    const auto &path = prim.GetPath();
-    UsdStageWeakPtr stage = prim.GetStage();
-    std::function<void()> usdApiFunc = [=]() {
-        auto prim = stage->GetPrimAtPath(path);
-        if (prim.HasVariantSets()) {
-            auto variantSet = prim.GetVariantSet(variantName);
-            std::function<void()> variantSetFunc = std::bind(func, &variantSet, arguments...);
-            variantSetFunc();
+///
+/// The objects passed to ExecuteAfterDraw are not kept as is between the draw and the call, they are converted
+/// to stable handles: a layer or stage weak pointer and a path. The object is retrieved from its handle
+/// when the command runs and the call is skipped if it doesn't exist anymore.
+///
+/// ObjectHandle<ObjectT> gives the handle type for each edited object type. A handle provides:
+///    Get() returning the object or an invalid object
+///    GetLayer() returning the layer to record the changes on
+///
+template <typename ObjectT, typename Enable = void> struct ObjectHandle;
+
+template <> struct ObjectHandle<SdfLayerHandle> {
+    ObjectHandle(const SdfLayerHandle &layer) : _layer(layer) {}
+    SdfLayerHandle Get() const { return _layer; }
+    SdfLayerHandle GetLayer() const { return _layer; }
+    SdfLayerHandle _layer;
+};
+
+template <> struct ObjectHandle<SdfLayerRefPtr> : ObjectHandle<SdfLayerHandle> {
+    ObjectHandle(const SdfLayerRefPtr &layer) : ObjectHandle<SdfLayerHandle>(layer) {}
+};
+
+template <> struct ObjectHandle<UsdStageWeakPtr> {
+    ObjectHandle(const UsdStageWeakPtr &stage) : _stage(stage) {}
+    UsdStageWeakPtr Get() const { return _stage; }
+    SdfLayerHandle GetLayer() const { return _stage ? _stage->GetEditTarget().GetLayer() : SdfLayerHandle(); }
+    UsdStageWeakPtr _stage;
+};
+
+template <> struct ObjectHandle<UsdStageRefPtr> : ObjectHandle<UsdStageWeakPtr> {
+    ObjectHandle(const UsdStageRefPtr &stage) : ObjectHandle<UsdStageWeakPtr>(stage) {}
+};
+
+/// Specs: SdfPrimSpecHandle, SdfAttributeSpecHandle, SdfPropertySpecHandle, ...
+template <typename SpecT> struct ObjectHandle<SdfHandle<SpecT>> {
+    ObjectHandle(const SdfHandle<SpecT> &spec) {
+        if (spec) {
+            _layer = spec->GetLayer();
+            _path = spec->GetPath();
         }
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(stage->GetEditTarget().GetLayer(), usdApiFunc);
-}
-
-// NOTE: UsdGeomImageable and all other schema class will share the same code
-// TODO: template it if needed
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, const UsdGeomImageable &geom, ArgsT &&...arguments) {
-    const auto &path = geom.GetPrim().GetPath();
-    UsdStageWeakPtr stage = geom.GetPrim().GetStage();
-    std::function<void()> usdApiFunc = [=]() {
-        UsdGeomImageable geomPrim = UsdGeomImageable::Get(stage, path);
-        std::function<void()> primFunc = std::bind(func, &geomPrim, arguments...);
-        primFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(stage->GetEditTarget().GetLayer(), usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, SdfAttributeSpecHandle att, ArgsT &&...arguments) {
-    const auto path = att->GetPath();
-    const auto layer = att->GetLayer();
-    std::function<void()> usdApiFunc = [=]() {
-        auto primSpec = layer->GetAttributeAtPath(path);
-        std::function<void()> attFunc = std::bind(func, get_pointer(primSpec), arguments...);
-        attFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(layer, usdApiFunc);
-}
-
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, SdfPropertySpecHandle att, ArgsT &&...arguments) {
-    const auto path = att->GetPath();
-    const auto layer = att->GetLayer();
-    std::function<void()> usdApiFunc = [=]() {
-        auto primSpec = layer->GetPropertyAtPath(path);
-        std::function<void()> attFunc = std::bind(func, get_pointer(primSpec), arguments...);
-        attFunc();
-    };
-    ExecuteAfterDraw<UsdFunctionCall>(layer, usdApiFunc);
-}
+    }
+    SdfHandle<SpecT> Get() const { return _layer ? TfDynamic_cast<SdfHandle<SpecT>>(_layer->GetObjectAtPath(_path)) : SdfHandle<SpecT>(); }
+    SdfLayerHandle GetLayer() const { return _layer; }
+    SdfLayerHandle _layer;
+    SdfPath _path;
+};
+
+/// Usd objects: UsdPrim, UsdAttribute, UsdRelationship, ...
+template <typename UsdObjectT>
+struct ObjectHandle<UsdObjectT, typename std::enable_if<std::is_base_of<UsdObject, UsdObjectT>::value>::type>
+    : ObjectHandle<UsdStageWeakPtr> {
+    ObjectHandle(const UsdObjectT &object)
+        : ObjectHandle<UsdStageWeakPtr>(object ? object.GetStage() : UsdStageWeakPtr()), _path(object ? object.GetPath() : SdfPath()) {}
+    UsdObjectT Get() const { return _stage ? _stage->GetObjectAtPath(_path).template As<UsdObjectT>() : UsdObjectT(); }
+    SdfPath _path;
+};
+
+/// Schemas: UsdGeomImageable, UsdGeomXformCommonAPI, ...
+template <typename SchemaT>
+struct ObjectHandle<SchemaT, typename std::enable_if<std::is_base_of<UsdSchemaBase, SchemaT>::value>::type>
+    : ObjectHandle<UsdStageWeakPtr> {
+    ObjectHandle(const SchemaT &schema)
+        : ObjectHandle<UsdStageWeakPtr>(schema ? schema.GetPrim().GetStage() : UsdStageWeakPtr()),
+          _path(schema ? schema.GetPath() : SdfPath()) {}
+    SchemaT Get() const { return _stage ? SchemaT(_stage->GetPrimAtPath(_path)) : SchemaT(); }
+    SdfPath _path;
+};
+
+template <> struct ObjectHandle<UsdVariantSet> : ObjectHandle<UsdStageWeakPtr> {
+    ObjectHandle(const UsdVariantSet &variantSet)
+        : ObjectHandle<UsdStageWeakPtr>(variantSet ? variantSet.GetPrim().GetStage() : UsdStageWeakPtr()),
+          _path(variantSet ? variantSet.GetPrim().GetPath() : SdfPath()), _variantSetName(variantSet.GetName()) {}
+    UsdVariantSet Get() const {
+        // An invalid prim gives an invalid variant set, the call is then skipped
+        UsdPrim prim = _stage ? _stage->GetPrimAtPath(_path) : UsdPrim();
+        if (prim && !prim.HasVariantSets()) {
+            prim = UsdPrim();
+        }
+        return prim.GetVariantSet(_variantSetName);
+    }
+    SdfPath _path;
+    std::string _variantSetName;
+};
+
+/// Pointer to the object the member function is called on
+template <typename ObjectT> ObjectT *GetObjectPointer(ObjectT &object) { return &object; }
+template <typename ObjectT> ObjectT *GetObjectPointer(TfRefPtr<ObjectT> &object) { return get_pointer(object); }
+template <typename ObjectT> ObjectT *GetObjectPointer(TfWeakPtr<ObjectT> &object) { return get_pointer(object); }
+template <typename SpecT> SpecT *GetObjectPointer(SdfHandle<SpecT> &object) { return get_pointer(object); }
+
+/// Type erased call waiting in the command queue
+struct DeferredCallBase {
+    virtual ~DeferredCallBase() = default;
+    virtual SdfLayerHandle GetLayer() const = 0;
+    virtual void Call() = 0;
+};
+
+/// Member function call on an object retrieved from its handle, the arguments are copied
+template <typename HandleT, typename FuncT, typename... ArgsT> struct DeferredCall final : public DeferredCallBase {
+    template <typename ObjectT, typename... ArgumentsT>
+    DeferredCall(const ObjectT &object, FuncT func, ArgumentsT &&...arguments)
+        : _handle(object), _func(func), _arguments(std::forward<ArgumentsT>(arguments)...) {}
+
+    SdfLayerHandle GetLayer() const override { return _handle.GetLayer(); }
+
+    void Call() override { _Call(std::index_sequence_for<ArgsT...>()); }
+
+  private:
+    template <size_t... Indices> void _Call(std::index_sequence<Indices...>) {
+        auto object = _handle.Get();
+        if (object) {
+            (GetObjectPointer(object)->*_func)(std::get<Indices>(_arguments)...);
+        }
+    }
 
-template <typename FuncT, typename... ArgsT>
-void ExecuteAfterDraw(FuncT &&func, const UsdGeomXformCommonAPI &api, ArgsT &&...arguments) {
-    const auto prim = api.GetPrim();
-    if (prim) {
-        const auto path = prim.GetPath();
-        const auto stage = prim.GetStage(); // TODO it's copying a weakptr, not really a good idea
-        std::function<void()> usdApiFunc = [=]() {
-            if (stage) {
-                UsdGeomXformCommonAPI api(stage->GetPrimAtPath(path));
-                std::function<void()> apiFunc = std::bind(func, api, arguments...);
-                apiFunc();
-            }
-        };
-        ExecuteAfterDraw<UsdFunctionCall>(stage->GetEditTarget().GetLayer(), usdApiFunc);
+    HandleT _handle;
+    FuncT _func;
+    std::tuple<ArgsT...> _arguments;
+};
+
+/// Size of the inline storage of the deferred call, there is no allocation when posting a call
+constexpr size_t DeferredCallStorageSize = 256;
+
+/// Returns the storage for the next deferred call or nullptr if a command is already waiting
+void *AcquireDeferredCallStorage();
+
+/// Post the deferred call constructed in the storage returned by AcquireDeferredCallStorage
+void PostDeferredCall(DeferredCallBase *call);
+
+/// Returns false if the call was dropped because another command is already waiting
+template <typename FuncT, typename ObjectT, typename... ArgsT>
+bool ExecuteAfterDraw(FuncT &&func, const ObjectT &object, ArgsT &&...arguments) {
+    using DeferredCallT = DeferredCall<ObjectHandle<ObjectT>, typename std::decay<FuncT>::type, typename std::decay<ArgsT>::type...>;
+    static_assert(sizeof(DeferredCallT) <= DeferredCallStorageSize, "DeferredCallStorageSize is too small for this call");
+    static_assert(alignof(DeferredCallT) <= alignof(std::max_align_t), "DeferredCall alignment is not supported");
+    if (void *storage = AcquireDeferredCallStorage()) {
+        PostDeferredCall(new (storage) DeferredCallT(object, func, std::forward<ArgsT>(arguments)...));
+        return true;
     }
+    return false;
 }
 
-/////// NOTES for later
-///// 1. To remove template clutter above, it might be possible to reduce all the templates into one that will find use an object location or identity.
-// template <typename HandleT, typename UsdObjectT>
-// HandleT GetHandleTo(UsdObjectT object);
-//
-// template <typename HandleT, typename UsdObjectT>
-// UsdObjectT GetObjectFrom(HandleT object);
-//
-// template<typename FuncT, typename UsdObjectT, typename... ArgsT>
-// void ExecuteAfterDraw(FuncT &&func, const UsdObjectT &object, ArgsT&&... arguments) {
-//    // Get a handle that will allow the command to access what we are looking at
-//    // The handle needs to be copyable
-//    auto handle = GetHandleTo(object);
-//    std::function<void()> usdApiFunction = [=]() {
-//        auto object = GetObjectFrom(handle);
-//        std::function<void()> doIt = std::bind(func, object, arguments...);
-//        doIt();
-//    };
-//    ExecuteAfterDraw<UsdFunctionCall>(layer, usdApiFunction);
-//}
-//// There is a identity.h and Sdf_Identity type that could be used for that purpose
-//// it identifies the logical object behind an SdfSpec.
-////
-//// 2. UsdFunctionCall is not persistent, it creates another command and it destroyed after creating it.
-//// We could simply copy the handle/ref/weak/ptrs
-
-
 /// Process the commands waiting in the queue. Only one command would be waiting at the moment
 void ExecuteCommands();
 
+/// Run the function immediately and store its changes on the layer in a new undo/redo command.
+/// It is meant for edits which are not coming from the ui, like the replay of the edit journal.
+void ExecuteAndRecord(SdfLayerRefPtr layer, const std::function<void()> &func);
+
 ///
 /// Allows to record one command spanning multiple frames.
 /// It is used in the manipulators, to record only one command for a translation/rotation etc.
@@ -221,3 +222,19 @@ void ExecuteCommands();
 void BeginEdition(UsdStageRefPtr);
 void BeginEdition(SdfLayerRefPtr);
 void EndEdition();
+
+///
+/// The stages are read by background tasks, like the outliner search. The edits made by the commands and during
+/// the editions hold the stage edit lock exclusively, the background tasks hold it shared for short batches of reads
+/// and stop when the edit epoch has changed, meaning a pending or finished edit.
+/// Locking is only done by the ui thread and can be nested.
+///
+void LockStageEdits();
+void UnlockStageEdits();
+std::shared_timed_mutex &GetStageEditMutex();
+uint64_t GetStageEditEpoch();
+bool IsStageEditLocked();
+
+/// Take the stage edit lock shared from a background task. It doesn't block forever, the ui thread might be waiting
+/// for the task to be cancelled. Returns false if cancelled is set before the lock is taken
+bool LockStageEditsShared(std::shared_lock<std::shared_timed_mutex> &lock, const std::atomic<bool> &cancelled);
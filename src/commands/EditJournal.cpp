@@ -0,0 +1,1340 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <pxr/base/gf/half.h>
+#include <pxr/base/gf/matrix2d.h>
+#include <pxr/base/gf/matrix3d.h>
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/quatd.h>
+#include <pxr/base/gf/quatf.h>
+#include <pxr/base/gf/quath.h>
+#include <pxr/base/gf/vec2d.h>
+#include <pxr/base/gf/vec2f.h>
+#include <pxr/base/gf/vec2h.h>
+#include <pxr/base/gf/vec2i.h>
+#include <pxr/base/gf/vec3d.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/gf/vec3h.h>
+#include <pxr/base/gf/vec3i.h>
+#include <pxr/base/gf/vec4d.h>
+#include <pxr/base/gf/vec4f.h>
+#include <pxr/base/gf/vec4h.h>
+#include <pxr/base/gf/vec4i.h>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/getenv.h>
+#include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/base/vt/dictionary.h>
+#include <pxr/usd/sdf/assetPath.h>
+#include <pxr/usd/sdf/changeBlock.h>
+#include <pxr/usd/sdf/layerOffset.h>
+#include <pxr/usd/sdf/layerStateDelegate.h>
+#include <pxr/usd/sdf/listOp.h>
+#include <pxr/usd/sdf/notice.h>
+#include <pxr/usd/sdf/payload.h>
+#include <pxr/usd/sdf/reference.h>
+#include "EditJournal.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+///
+/// Journal file layout:
+///    magic string
+///    records: [uint32 payload size][uint8 record type][payload]
+/// A crash can leave a truncated record at the end of the file, it is ignored when reading.
+///
+static constexpr char JournalMagic[] = "usdtweak journal 1";
+
+/// The journals are named after the process writing them, the lock file next to a journal is held while it is written
+static constexpr char JournalDirectoryName[] = "usdtweak";
+static constexpr char JournalFileExtension[] = ".journal";
+static constexpr char JournalLockExtension[] = ".lock";
+
+/// Number of queued entries waking up the writing thread
+static constexpr size_t JournalBatchSize = 512;
+
+/// Maximum time an entry waits in the queue before being written
+static constexpr std::chrono::milliseconds JournalFlushInterval(250);
+
+enum class JournalRecord : uint8_t {
+    Layer,
+    LayerSaved,
+    SetField,
+    SetFieldDictValueByKey,
+    SetTimeSample,
+    CreateSpec,
+    DeleteSpec,
+    MoveSpec,
+    PushChildToken,
+    PushChildPath,
+    PopChildToken,
+    PopChildPath,
+    Commit,
+    Undo,
+    Redo
+};
+
+/// An entry of the journal, as queued by the ui thread or read back from the file
+struct JournalEntry {
+    JournalRecord record;
+    uint32_t layerId = 0;
+    SdfPath path;
+    SdfPath pathValue;   // MoveSpec new path and path children
+    TfToken fieldName;
+    TfToken tokenValue;  // Dictionary key path and token children
+    VtValue value;
+    double timeCode = 0.0;
+    SdfSpecType specType = SdfSpecTypeUnknown;
+    bool inert = false;
+    bool isValueSupported = true;
+    std::string identifier; // Layer identifier, real path and checksum of the file
+    std::string realPath;
+    uint64_t checksum = 0;
+};
+
+///
+/// Binary streams
+///
+struct JournalOutputStream {
+    void Write(const void *data, size_t size) { buffer.append(static_cast<const char *>(data), size); }
+    template <typename T> void WritePod(const T &value) { Write(&value, sizeof(T)); }
+    void WriteString(const std::string &str) {
+        WritePod<uint64_t>(str.size());
+        Write(str.data(), str.size());
+    }
+    std::string buffer;
+};
+
+struct JournalInputStream {
+    JournalInputStream(const char *begin, const char *end) : cursor(begin), end(end) {}
+    bool Read(void *data, size_t size) {
+        if (static_cast<size_t>(end - cursor) < size) {
+            return false;
+        }
+        std::memcpy(data, cursor, size);
+        cursor += size;
+        return true;
+    }
+    template <typename T> bool ReadPod(T &value) { return Read(&value, sizeof(T)); }
+    bool ReadString(std::string &str) {
+        uint64_t size = 0;
+        if (!ReadPod(size) || static_cast<uint64_t>(end - cursor) < size) {
+            return false;
+        }
+        str.assign(cursor, size);
+        cursor += size;
+        return true;
+    }
+    const char *cursor;
+    const char *end;
+};
+
+///
+/// Value codec. The values are identified by a type byte followed by their data.
+/// Plain old data types are copied as is: the journal is only read back on the machine which wrote it.
+///
+using JournalPodTypes = std::tuple<bool, unsigned char, int, unsigned int, int64_t, uint64_t, GfHalf, float, double,
+                                   GfVec2i, GfVec3i, GfVec4i, GfVec2h, GfVec3h, GfVec4h, GfVec2f, GfVec3f, GfVec4f, GfVec2d,
+                                   GfVec3d, GfVec4d, GfQuath, GfQuatf, GfQuatd, GfMatrix2d, GfMatrix3d, GfMatrix4d,
+                                   SdfSpecifier, SdfVariability, SdfPermission>;
+constexpr size_t NumJournalPodTypes = std::tuple_size<JournalPodTypes>::value;
+
+enum JournalValueType : uint8_t {
+    EmptyValueType = 0,
+    PodValueType = 1,                          // + index in JournalPodTypes
+    PodArrayValueType = 64,                    // + index in JournalPodTypes
+    StringValueType = 128,
+    TokenValueType,
+    PathValueType,
+    AssetPathValueType,
+    StringArrayValueType,
+    TokenArrayValueType,
+    AssetPathArrayValueType,
+    StringVectorValueType,
+    TokenVectorValueType,
+    PathVectorValueType,
+    LayerOffsetVectorValueType,
+    DictionaryValueType,
+    TimeSamplesValueType,
+    VariantSelectionValueType,
+    StringListOpValueType,
+    TokenListOpValueType,
+    PathListOpValueType,
+    ReferenceListOpValueType,
+    PayloadListOpValueType,
+    UnsupportedValueType = 255
+};
+static_assert(NumJournalPodTypes < PodArrayValueType - PodValueType, "Too many pod types for the journal");
+
+static bool EncodeValue(JournalOutputStream &out, const VtValue &value);
+static bool DecodeValue(JournalInputStream &in, VtValue &value);
+
+// Items of the containers
+static void WriteItem(JournalOutputStream &out, const std::string &item) { out.WriteString(item); }
+static void WriteItem(JournalOutputStream &out, const TfToken &item) { out.WriteString(item.GetString()); }
+static void WriteItem(JournalOutputStream &out, const SdfPath &item) { out.WriteString(item.GetString()); }
+static void WriteItem(JournalOutputStream &out, const SdfAssetPath &item) { out.WriteString(item.GetAssetPath()); }
+static void WriteItem(JournalOutputStream &out, const SdfLayerOffset &item) {
+    out.WritePod(item.GetOffset());
+    out.WritePod(item.GetScale());
+}
+static void WriteItem(JournalOutputStream &out, const SdfPayload &item) {
+    out.WriteString(item.GetAssetPath());
+    WriteItem(out, item.GetPrimPath());
+    WriteItem(out, item.GetLayerOffset());
+}
+
+static bool ReadItem(JournalInputStream &in, std::string &item) { return in.ReadString(item); }
+static bool ReadItem(JournalInputStream &in, TfToken &item) {
+    std::string str;
+    if (!in.ReadString(str)) {
+        return false;
+    }
+    item = TfToken(str);
+    return true;
+}
+static bool ReadItem(JournalInputStream &in, SdfPath &item) {
+    std::string str;
+    if (!in.ReadString(str)) {
+        return false;
+    }
+    item = str.empty() ? SdfPath() : SdfPath(str);
+    return true;
+}
+static bool ReadItem(JournalInputStream &in, SdfAssetPath &item) {
+    std::string str;
+    if (!in.ReadString(str)) {
+        return false;
+    }
+    item = SdfAssetPath(str);
+    return true;
+}
+static bool ReadItem(JournalInputStream &in, SdfLayerOffset &item) {
+    double offset = 0.0;
+    double scale = 1.0;
+    if (!in.ReadPod(offset) || !in.ReadPod(scale)) {
+        return false;
+    }
+    item = SdfLayerOffset(offset, scale);
+    return true;
+}
+static bool ReadItem(JournalInputStream &in, SdfPayload &item) {
+    std::string assetPath;
+    SdfPath primPath;
+    SdfLayerOffset layerOffset;
+    if (!in.ReadString(assetPath) || !ReadItem(in, primPath) || !ReadItem(in, layerOffset)) {
+        return false;
+    }
+    item = SdfPayload(assetPath, primPath, layerOffset);
+    return true;
+}
+
+// References carry a dictionary which might hold unsupported values
+static bool WriteItem(JournalOutputStream &out, const SdfReference &item) {
+    out.WriteString(item.GetAssetPath());
+    WriteItem(out, item.GetPrimPath());
+    WriteItem(out, item.GetLayerOffset());
+    return EncodeValue(out, VtValue(item.GetCustomData()));
+}
+static bool ReadItem(JournalInputStream &in, SdfReference &item) {
+    std::string assetPath;
+    SdfPath primPath;
+    SdfLayerOffset layerOffset;
+    VtValue customData;
+    if (!in.ReadString(assetPath) || !ReadItem(in, primPath) || !ReadItem(in, layerOffset) || !DecodeValue(in, customData) ||
+        !customData.IsHolding<VtDictionary>()) {
+        return false;
+    }
+    item = SdfReference(assetPath, primPath, layerOffset, customData.UncheckedGet<VtDictionary>());
+    return true;
+}
+
+template <typename ContainerT> static bool WriteItems(JournalOutputStream &out, const ContainerT &items) {
+    out.WritePod<uint64_t>(items.size());
+    for (const auto &item : items) {
+        WriteItem(out, item);
+    }
+    return true;
+}
+
+// References can hold unsupported values in their custom data
+static bool WriteItems(JournalOutputStream &out, const std::vector<SdfReference> &items) {
+    bool supported = true;
+    out.WritePod<uint64_t>(items.size());
+    for (const auto &item : items) {
+        supported = WriteItem(out, item) && supported;
+    }
+    return supported;
+}
+
+template <typename ContainerT> static bool ReadItems(JournalInputStream &in, ContainerT &items) {
+    uint64_t size = 0;
+    if (!in.ReadPod(size)) {
+        return false;
+    }
+    items.clear();
+    for (uint64_t i = 0; i < size; ++i) {
+        typename ContainerT::value_type item;
+        if (!ReadItem(in, item)) {
+            return false;
+        }
+        items.push_back(item);
+    }
+    return true;
+}
+
+template <typename T> static bool WriteListOp(JournalOutputStream &out, const SdfListOp<T> &listOp) {
+    out.WritePod(listOp.IsExplicit());
+    if (listOp.IsExplicit()) {
+        return WriteItems(out, listOp.GetExplicitItems());
+    }
+    bool supported = WriteItems(out, listOp.GetAddedItems());
+    supported = WriteItems(out, listOp.GetPrependedItems()) && supported;
+    supported = WriteItems(out, listOp.GetAppendedItems()) && supported;
+    supported = WriteItems(out, listOp.GetDeletedItems()) && supported;
+    return WriteItems(out, listOp.GetOrderedItems()) && supported;
+}
+
+template <typename T> static bool ReadListOp(JournalInputStream &in, VtValue &value) {
+    bool isExplicit = false;
+    if (!in.ReadPod(isExplicit)) {
+        return false;
+    }
+    SdfListOp<T> listOp;
+    typename SdfListOp<T>::ItemVector items;
+    if (isExplicit) {
+        if (!ReadItems(in, items)) {
+            return false;
+        }
+        listOp.SetExplicitItems(items);
+    } else {
+        if (!ReadItems(in, items)) {
+            return false;
+        }
+        listOp.SetAddedItems(items);
+        if (!ReadItems(in, items)) {
+            return false;
+        }
+        listOp.SetPrependedItems(items);
+        if (!ReadItems(in, items)) {
+            return false;
+        }
+        listOp.SetAppendedItems(items);
+        if (!ReadItems(in, items)) {
+            return false;
+        }
+        listOp.SetDeletedItems(items);
+        if (!ReadItems(in, items)) {
+            return false;
+        }
+        listOp.SetOrderedItems(items);
+    }
+    value = VtValue::Take(listOp);
+    return true;
+}
+
+template <typename ContainerT> static bool ReadContainer(JournalInputStream &in, VtValue &value) {
+    ContainerT items;
+    if (!ReadItems(in, items)) {
+        return false;
+    }
+    value = VtValue::Take(items);
+    return true;
+}
+
+// Pod types and arrays of pod types, iterating on JournalPodTypes
+static bool EncodePodValue(JournalOutputStream &, const VtValue &, std::integral_constant<size_t, NumJournalPodTypes>) {
+    return false;
+}
+
+template <size_t Index>
+static bool EncodePodValue(JournalOutputStream &out, const VtValue &value, std::integral_constant<size_t, Index>) {
+    using PodT = typename std::tuple_element<Index, JournalPodTypes>::type;
+    if (value.IsHolding<PodT>()) {
+        out.WritePod<uint8_t>(PodValueType + Index);
+        out.WritePod(value.UncheckedGet<PodT>());
+        return true;
+    }
+    if (value.IsHolding<VtArray<PodT>>()) {
+        const auto &array = value.UncheckedGet<VtArray<PodT>>();
+        out.WritePod<uint8_t>(PodArrayValueType + Index);
+        out.WritePod<uint64_t>(array.size());
+        out.Write(array.cdata(), array.size() * sizeof(PodT));
+        return true;
+    }
+    return EncodePodValue(out, value, std::integral_constant<size_t, Index + 1>());
+}
+
+static bool DecodePodValue(JournalInputStream &, size_t, bool, VtValue &, std::integral_constant<size_t, NumJournalPodTypes>) {
+    return false;
+}
+
+template <size_t Index>
+static bool DecodePodValue(JournalInputStream &in, size_t podIndex, bool isArray, VtValue &value,
+                           std::integral_constant<size_t, Index>) {
+    using PodT = typename std::tuple_element<Index, JournalPodTypes>::type;
+    if (podIndex != Index) {
+        return DecodePodValue(in, podIndex, isArray, value, std::integral_constant<size_t, Index + 1>());
+    }
+    if (isArray) {
+        uint64_t size = 0;
+        if (!in.ReadPod(size) || static_cast<uint64_t>(in.end - in.cursor) < size * sizeof(PodT)) {
+            return false;
+        }
+        VtArray<PodT> array(size);
+        in.Read(array.data(), size * sizeof(PodT));
+        value = VtValue::Take(array);
+        return true;
+    }
+    PodT pod;
+    if (!in.ReadPod(pod)) {
+        return false;
+    }
+    value = VtValue(pod);
+    return true;
+}
+
+// Returns false if the value or one of its sub values is not supported, the stream is then unusable
+static bool EncodeValue(JournalOutputStream &out, const VtValue &value) {
+    if (value.IsEmpty()) {
+        out.WritePod<uint8_t>(EmptyValueType);
+        return true;
+    }
+    if (EncodePodValue(out, value, std::integral_constant<size_t, 0>())) {
+        return true;
+    }
+    if (value.IsHolding<std::string>()) {
+        out.WritePod<uint8_t>(StringValueType);
+        WriteItem(out, value.UncheckedGet<std::string>());
+    } else if (value.IsHolding<TfToken>()) {
+        out.WritePod<uint8_t>(TokenValueType);
+        WriteItem(out, value.UncheckedGet<TfToken>());
+    } else if (value.IsHolding<SdfPath>()) {
+        out.WritePod<uint8_t>(PathValueType);
+        WriteItem(out, value.UncheckedGet<SdfPath>());
+    } else if (value.IsHolding<SdfAssetPath>()) {
+        out.WritePod<uint8_t>(AssetPathValueType);
+        WriteItem(out, value.UncheckedGet<SdfAssetPath>());
+    } else if (value.IsHolding<VtArray<std::string>>()) {
+        out.WritePod<uint8_t>(StringArrayValueType);
+        WriteItems(out, value.UncheckedGet<VtArray<std::string>>());
+    } else if (value.IsHolding<VtArray<TfToken>>()) {
+        out.WritePod<uint8_t>(TokenArrayValueType);
+        WriteItems(out, value.UncheckedGet<VtArray<TfToken>>());
+    } else if (value.IsHolding<VtArray<SdfAssetPath>>()) {
+        out.WritePod<uint8_t>(AssetPathArrayValueType);
+        WriteItems(out, value.UncheckedGet<VtArray<SdfAssetPath>>());
+    } else if (value.IsHolding<std::vector<std::string>>()) {
+        out.WritePod<uint8_t>(StringVectorValueType);
+        WriteItems(out, value.UncheckedGet<std::vector<std::string>>());
+    } else if (value.IsHolding<TfTokenVector>()) {
+        out.WritePod<uint8_t>(TokenVectorValueType);
+        WriteItems(out, value.UncheckedGet<TfTokenVector>());
+    } else if (value.IsHolding<SdfPathVector>()) {
+        out.WritePod<uint8_t>(PathVectorValueType);
+        WriteItems(out, value.UncheckedGet<SdfPathVector>());
+    } else if (value.IsHolding<SdfLayerOffsetVector>()) {
+        out.WritePod<uint8_t>(LayerOffsetVectorValueType);
+        WriteItems(out, value.UncheckedGet<SdfLayerOffsetVector>());
+    } else if (value.IsHolding<VtDictionary>()) {
+        const auto &dictionary = value.UncheckedGet<VtDictionary>();
+        out.WritePod<uint8_t>(DictionaryValueType);
+        out.WritePod<uint64_t>(dictionary.size());
+        for (const auto &item : dictionary) {
+            WriteItem(out, item.first);
+            if (!EncodeValue(out, item.second)) {
+                return false;
+            }
+        }
+    } else if (value.IsHolding<SdfTimeSampleMap>()) {
+        const auto &samples = value.UncheckedGet<SdfTimeSampleMap>();
+        out.WritePod<uint8_t>(TimeSamplesValueType);
+        out.WritePod<uint64_t>(samples.size());
+        for (const auto &sample : samples) {
+            out.WritePod(sample.first);
+            if (!EncodeValue(out, sample.second)) {
+                return false;
+            }
+        }
+    } else if (value.IsHolding<SdfVariantSelectionMap>()) {
+        const auto &selections = value.UncheckedGet<SdfVariantSelectionMap>();
+        out.WritePod<uint8_t>(VariantSelectionValueType);
+        out.WritePod<uint64_t>(selections.size());
+        for (const auto &selection : selections) {
+            WriteItem(out, selection.first);
+            WriteItem(out, selection.second);
+        }
+    } else if (value.IsHolding<SdfStringListOp>()) {
+        out.WritePod<uint8_t>(StringListOpValueType);
+        return WriteListOp(out, value.UncheckedGet<SdfStringListOp>());
+    } else if (value.IsHolding<SdfTokenListOp>()) {
+        out.WritePod<uint8_t>(TokenListOpValueType);
+        return WriteListOp(out, value.UncheckedGet<SdfTokenListOp>());
+    } else if (value.IsHolding<SdfPathListOp>()) {
+        out.WritePod<uint8_t>(PathListOpValueType);
+        return WriteListOp(out, value.UncheckedGet<SdfPathListOp>());
+    } else if (value.IsHolding<SdfReferenceListOp>()) {
+        out.WritePod<uint8_t>(ReferenceListOpValueType);
+        return WriteListOp(out, value.UncheckedGet<SdfReferenceListOp>());
+    } else if (value.IsHolding<SdfPayloadListOp>()) {
+        out.WritePod<uint8_t>(PayloadListOpValueType);
+        return WriteListOp(out, value.UncheckedGet<SdfPayloadListOp>());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool DecodeValue(JournalInputStream &in, VtValue &value) {
+    uint8_t type = UnsupportedValueType;
+    if (!in.ReadPod(type)) {
+        return false;
+    }
+    if (type == EmptyValueType) {
+        value = VtValue();
+        return true;
+    }
+    if (type >= PodValueType && type < PodValueType + NumJournalPodTypes) {
+        return DecodePodValue(in, type - PodValueType, false, value, std::integral_constant<size_t, 0>());
+    }
+    if (type >= PodArrayValueType && type < PodArrayValueType + NumJournalPodTypes) {
+        return DecodePodValue(in, type - PodArrayValueType, true, value, std::integral_constant<size_t, 0>());
+    }
+    switch (type) {
+    case StringValueType: {
+        std::string item;
+        if (!ReadItem(in, item)) {
+            return false;
+        }
+        value = VtValue::Take(item);
+        return true;
+    }
+    case TokenValueType: {
+        TfToken item;
+        if (!ReadItem(in, item)) {
+            return false;
+        }
+        value = VtValue(item);
+        return true;
+    }
+    case PathValueType: {
+        SdfPath item;
+        if (!ReadItem(in, item)) {
+            return false;
+        }
+        value = VtValue(item);
+        return true;
+    }
+    case AssetPathValueType: {
+        SdfAssetPath item;
+        if (!ReadItem(in, item)) {
+            return false;
+        }
+        value = VtValue(item);
+        return true;
+    }
+    case StringArrayValueType:
+        return ReadContainer<VtArray<std::string>>(in, value);
+    case TokenArrayValueType:
+        return ReadContainer<VtArray<TfToken>>(in, value);
+    case AssetPathArrayValueType:
+        return ReadContainer<VtArray<SdfAssetPath>>(in, value);
+    case StringVectorValueType:
+        return ReadContainer<std::vector<std::string>>(in, value);
+    case TokenVectorValueType:
+        return ReadContainer<TfTokenVector>(in, value);
+    case PathVectorValueType:
+        return ReadContainer<SdfPathVector>(in, value);
+    case LayerOffsetVectorValueType:
+        return ReadContainer<SdfLayerOffsetVector>(in, value);
+    case DictionaryValueType: {
+        uint64_t size = 0;
+        if (!in.ReadPod(size)) {
+            return false;
+        }
+        VtDictionary dictionary;
+        for (uint64_t i = 0; i < size; ++i) {
+            std::string key;
+            VtValue item;
+            if (!ReadItem(in, key) || !DecodeValue(in, item)) {
+                return false;
+            }
+            dictionary[key] = item;
+        }
+        value = VtValue::Take(dictionary);
+        return true;
+    }
+    case TimeSamplesValueType: {
+        uint64_t size = 0;
+        if (!in.ReadPod(size)) {
+            return false;
+        }
+        SdfTimeSampleMap samples;
+        for (uint64_t i = 0; i < size; ++i) {
+            double timeCode = 0.0;
+            VtValue sample;
+            if (!in.ReadPod(timeCode) || !DecodeValue(in, sample)) {
+                return false;
+            }
+            samples[timeCode] = sample;
+        }
+        value = VtValue::Take(samples);
+        return true;
+    }
+    case VariantSelectionValueType: {
+        uint64_t size = 0;
+        if (!in.ReadPod(size)) {
+            return false;
+        }
+        SdfVariantSelectionMap selections;
+        for (uint64_t i = 0; i < size; ++i) {
+            std::string variantSet;
+            std::string variant;
+            if (!ReadItem(in, variantSet) || !ReadItem(in, variant)) {
+                return false;
+            }
+            selections[variantSet] = variant;
+        }
+        value = VtValue::Take(selections);
+        return true;
+    }
+    case StringListOpValueType:
+        return ReadListOp<std::string>(in, value);
+    case TokenListOpValueType:
+        return ReadListOp<TfToken>(in, value);
+    case PathListOpValueType:
+        return ReadListOp<SdfPath>(in, value);
+    case ReferenceListOpValueType:
+        return ReadListOp<SdfReference>(in, value);
+    case PayloadListOpValueType:
+        return ReadListOp<SdfPayload>(in, value);
+    default:
+        return false;
+    }
+}
+
+///
+/// Records
+///
+
+/// FNV-1a hash of the file content, 0 if the file can't be read
+static uint64_t ComputeFileChecksum(const std::string &filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (filePath.empty() || !file) {
+        return 0;
+    }
+    uint64_t hash = 14695981039346656037ULL;
+    char buffer[64 * 1024];
+    while (file) {
+        file.read(buffer, sizeof(buffer));
+        const std::streamsize count = file.gcount();
+        for (std::streamsize i = 0; i < count; ++i) {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static void EncodeEntry(JournalOutputStream &out, JournalEntry &entry) {
+    JournalOutputStream payload;
+    payload.WritePod(entry.record);
+    switch (entry.record) {
+    case JournalRecord::Layer:
+    case JournalRecord::LayerSaved:
+        // The checksum is computed here, on the writing thread
+        payload.WritePod(entry.layerId);
+        payload.WriteString(entry.identifier);
+        payload.WriteString(entry.realPath);
+        payload.WritePod(ComputeFileChecksum(entry.realPath));
+        break;
+    case JournalRecord::SetField:
+    case JournalRecord::SetFieldDictValueByKey:
+    case JournalRecord::SetTimeSample: {
+        payload.WritePod(entry.layerId);
+        WriteItem(payload, entry.path);
+        WriteItem(payload, entry.fieldName);
+        WriteItem(payload, entry.tokenValue);
+        payload.WritePod(entry.timeCode);
+        JournalOutputStream value;
+        if (EncodeValue(value, entry.value)) {
+            payload.Write(value.buffer.data(), value.buffer.size());
+        } else {
+            payload.WritePod<uint8_t>(UnsupportedValueType);
+        }
+        break;
+    }
+    case JournalRecord::CreateSpec:
+    case JournalRecord::DeleteSpec:
+        payload.WritePod(entry.layerId);
+        WriteItem(payload, entry.path);
+        payload.WritePod(entry.specType);
+        payload.WritePod(entry.inert);
+        break;
+    case JournalRecord::MoveSpec:
+    case JournalRecord::PushChildToken:
+    case JournalRecord::PushChildPath:
+    case JournalRecord::PopChildToken:
+    case JournalRecord::PopChildPath:
+        payload.WritePod(entry.layerId);
+        WriteItem(payload, entry.path);
+        WriteItem(payload, entry.fieldName);
+        WriteItem(payload, entry.tokenValue);
+        WriteItem(payload, entry.pathValue);
+        break;
+    case JournalRecord::Commit:
+    case JournalRecord::Undo:
+    case JournalRecord::Redo:
+        break;
+    }
+    out.WritePod<uint32_t>(static_cast<uint32_t>(payload.buffer.size()));
+    out.Write(payload.buffer.data(), payload.buffer.size());
+}
+
+static bool DecodeEntry(JournalInputStream &in, JournalEntry &entry) {
+    if (!in.ReadPod(entry.record)) {
+        return false;
+    }
+    switch (entry.record) {
+    case JournalRecord::Layer:
+    case JournalRecord::LayerSaved:
+        return in.ReadPod(entry.layerId) && in.ReadString(entry.identifier) && in.ReadString(entry.realPath) &&
+               in.ReadPod(entry.checksum);
+    case JournalRecord::SetField:
+    case JournalRecord::SetFieldDictValueByKey:
+    case JournalRecord::SetTimeSample: {
+        if (!in.ReadPod(entry.layerId) || !ReadItem(in, entry.path) || !ReadItem(in, entry.fieldName) ||
+            !ReadItem(in, entry.tokenValue) || !in.ReadPod(entry.timeCode)) {
+            return false;
+        }
+        if (in.cursor < in.end && static_cast<uint8_t>(*in.cursor) == UnsupportedValueType) {
+            entry.isValueSupported = false;
+            return true;
+        }
+        return DecodeValue(in, entry.value);
+    }
+    case JournalRecord::CreateSpec:
+    case JournalRecord::DeleteSpec:
+        return in.ReadPod(entry.layerId) && ReadItem(in, entry.path) && in.ReadPod(entry.specType) && in.ReadPod(entry.inert);
+    case JournalRecord::MoveSpec:
+    case JournalRecord::PushChildToken:
+    case JournalRecord::PushChildPath:
+    case JournalRecord::PopChildToken:
+    case JournalRecord::PopChildPath:
+        return in.ReadPod(entry.layerId) && ReadItem(in, entry.path) && ReadItem(in, entry.fieldName) &&
+               ReadItem(in, entry.tokenValue) && ReadItem(in, entry.pathValue);
+    case JournalRecord::Commit:
+    case JournalRecord::Undo:
+    case JournalRecord::Redo:
+        return true;
+    default:
+        return false;
+    }
+}
+
+///
+/// Journal files
+///
+
+/// Lock telling the other instances that a journal is in use. The system releases it when the process ends, so a
+/// journal whose lock can be taken was left by a session which didn't exit cleanly
+class JournalLock {
+  public:
+    explicit JournalLock(const std::string &lockPath) : _lockPath(lockPath) {}
+    ~JournalLock() { Unlock(); }
+
+    // Delete copy
+    JournalLock(const JournalLock &) = delete;
+    JournalLock &operator=(const JournalLock &) = delete;
+
+    /// Take the lock without waiting, returns false if another process holds it
+    bool TryLock() {
+#ifdef _WIN32
+        // The file can't be opened by another process while this handle is open, and is removed when it is closed
+        _handle = CreateFileA(_lockPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        return _handle != INVALID_HANDLE_VALUE;
+#else
+        _fd = open(_lockPath.c_str(), O_RDWR | O_CREAT, 0600);
+        if (_fd >= 0 && flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+            close(_fd);
+            _fd = -1;
+        }
+        return _fd >= 0;
+#endif
+    }
+
+    /// Release the lock and remove the lock file
+    void Unlock() {
+#ifdef _WIN32
+        if (_handle != INVALID_HANDLE_VALUE) {
+            CloseHandle(_handle);
+            _handle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (_fd >= 0) {
+            unlink(_lockPath.c_str());
+            close(_fd);
+            _fd = -1;
+        }
+#endif
+    }
+
+  private:
+    std::string _lockPath;
+#ifdef _WIN32
+    HANDLE _handle = INVALID_HANDLE_VALUE;
+#else
+    int _fd = -1;
+#endif
+};
+
+static std::string GetJournalLockPath(const std::string &journalPath) { return journalPath + JournalLockExtension; }
+
+/// Journal name unique to this process: the process id is reused by the system, so the start time is added
+static std::string GetJournalFileName() {
+#ifdef _WIN32
+    const unsigned long processId = GetCurrentProcessId();
+#else
+    const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+    const auto startTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+    return TfStringPrintf("usdtweak-%lu-%lld%s", processId, static_cast<long long>(startTime.count()), JournalFileExtension);
+}
+
+std::string GetEditJournalDirectory() {
+#ifdef _WIN32
+    std::string dataDirectory = TfGetenv("LOCALAPPDATA");
+#else
+    std::string dataDirectory = TfGetenv("XDG_DATA_HOME");
+    if (dataDirectory.empty() && !TfGetenv("HOME").empty()) {
+        dataDirectory = TfStringCatPaths(TfGetenv("HOME"), ".local/share");
+    }
+#endif
+    if (dataDirectory.empty()) {
+        // The temporary directory can be shared by the users
+#ifdef _WIN32
+        return TfStringCatPaths(ArchGetTmpDir(), JournalDirectoryName);
+#else
+        return TfStringCatPaths(ArchGetTmpDir(), TfStringPrintf("%s-%lu", JournalDirectoryName, static_cast<unsigned long>(getuid())));
+#endif
+    }
+    return TfStringCatPaths(dataDirectory, JournalDirectoryName);
+}
+
+// Journal written by this process, only accessed by the ui thread
+static std::string journalFilePath;
+
+// Locks of the journals left by the crashed sessions and claimed by this process, only accessed by the ui thread
+static std::map<std::string, std::unique_ptr<JournalLock>> claimedJournals;
+
+std::string ClaimCrashedEditJournal(const std::string &journalDirectory) {
+    std::vector<std::string> fileNames;
+    if (!TfIsDir(journalDirectory) || !TfReadDir(journalDirectory, nullptr, &fileNames, nullptr, nullptr)) {
+        return std::string();
+    }
+    std::string claimedPath;
+    double claimedTime = 0.0;
+    for (const auto &fileName : fileNames) {
+        const std::string journalPath = TfStringCatPaths(journalDirectory, fileName);
+        if (!TfStringEndsWith(fileName, JournalFileExtension) || journalPath == journalFilePath ||
+            claimedJournals.count(journalPath)) {
+            continue;
+        }
+        // The lock of a running session is held, its journal is not touched
+        auto lock = std::unique_ptr<JournalLock>(new JournalLock(GetJournalLockPath(journalPath)));
+        if (!lock->TryLock()) {
+            continue;
+        }
+        if (!EditJournalExists(journalPath)) {
+            TfDeleteFile(journalPath);
+            continue;
+        }
+        // The most recent journal is proposed, the others stay on disk for the next sessions
+        double modificationTime = 0.0;
+        ArchGetModificationTime(journalPath.c_str(), &modificationTime);
+        if (claimedPath.empty() || modificationTime > claimedTime) {
+            claimedJournals.erase(claimedPath);
+            claimedPath = journalPath;
+            claimedTime = modificationTime;
+            claimedJournals[journalPath] = std::move(lock);
+        }
+    }
+    return claimedPath;
+}
+
+void RemoveCrashedEditJournal(const std::string &journalPath) {
+    auto claimed = claimedJournals.find(journalPath);
+    if (claimed != claimedJournals.end()) {
+        TfDeleteFile(journalPath);
+        claimedJournals.erase(claimed);
+    }
+}
+
+///
+/// Writing. The entries are queued by the ui thread and encoded and written by the journal thread.
+///
+static std::mutex journalMutex;
+static std::condition_variable journalCondition;
+static std::vector<JournalEntry> journalQueue; // Protected by journalMutex
+static bool journalStopRequested = false;      // Protected by journalMutex
+static std::thread journalThread;
+
+// Only accessed by the ui thread
+static bool journalEnabled = false;
+static std::unique_ptr<JournalLock> journalLock;
+static std::map<std::string, uint32_t> journalLayerIds; // layer identifier -> id in the journal
+
+static void WriteJournal(FILE *file) {
+    std::vector<JournalEntry> entries;
+    JournalOutputStream out;
+    std::unique_lock<std::mutex> lock(journalMutex);
+    bool stopRequested = false;
+    while (!stopRequested) {
+        journalCondition.wait_for(lock, JournalFlushInterval,
+                                  []() { return journalStopRequested || journalQueue.size() >= JournalBatchSize; });
+        entries.swap(journalQueue);
+        stopRequested = journalStopRequested;
+        lock.unlock();
+        for (auto &entry : entries) {
+            EncodeEntry(out, entry);
+        }
+        entries.clear();
+        if (!out.buffer.empty()) {
+            fwrite(out.buffer.data(), 1, out.buffer.size(), file);
+            fflush(file);
+            out.buffer.clear();
+        }
+        lock.lock();
+    }
+}
+
+static void QueueEntry(JournalEntry &&entry) {
+    std::lock_guard<std::mutex> lock(journalMutex);
+    journalQueue.emplace_back(std::move(entry));
+    if (journalQueue.size() >= JournalBatchSize) {
+        journalCondition.notify_one();
+    }
+}
+
+/// Returns the id of the layer in the journal, the first time a layer is seen its header is queued
+static uint32_t GetJournalLayerId(const SdfLayerHandle &layer) {
+    const std::string &identifier = layer->GetIdentifier();
+    auto layerId = journalLayerIds.find(identifier);
+    if (layerId != journalLayerIds.end()) {
+        return layerId->second;
+    }
+    JournalEntry entry{JournalRecord::Layer};
+    entry.layerId = static_cast<uint32_t>(journalLayerIds.size());
+    entry.identifier = identifier;
+    entry.realPath = layer->IsAnonymous() ? std::string() : layer->GetRealPath();
+    journalLayerIds[identifier] = entry.layerId;
+    QueueEntry(std::move(entry));
+    return journalLayerIds[identifier];
+}
+
+/// Listen to the layer saves to write a new checksum for the journaled layers
+class JournalSaveListener : public TfWeakBase {
+  public:
+    JournalSaveListener() { _key = TfNotice::Register(TfCreateWeakPtr(this), &JournalSaveListener::OnLayerSaved); }
+    ~JournalSaveListener() { TfNotice::Revoke(_key); }
+
+    void OnLayerSaved(const SdfNotice::LayerDidSaveLayerToFile &, const SdfLayerHandle &layer) {
+        if (!journalEnabled || !layer) {
+            return;
+        }
+        auto layerId = journalLayerIds.find(layer->GetIdentifier());
+        if (layerId != journalLayerIds.end()) {
+            JournalEntry entry{JournalRecord::LayerSaved};
+            entry.layerId = layerId->second;
+            entry.identifier = layer->GetIdentifier();
+            entry.realPath = layer->GetRealPath();
+            QueueEntry(std::move(entry));
+        }
+    }
+
+  private:
+    TfNotice::Key _key;
+};
+static std::unique_ptr<JournalSaveListener> journalSaveListener;
+
+void StartEditJournal(const std::string &journalDirectory) {
+    if (journalEnabled) {
+        return;
+    }
+    TfMakeDirs(journalDirectory, -1, true);
+    const std::string journalPath = TfStringCatPaths(journalDirectory, GetJournalFileName());
+    // Without its lock, the journal would be taken for a crashed one by the other instances
+    journalLock.reset(new JournalLock(GetJournalLockPath(journalPath)));
+    FILE *file = journalLock->TryLock() ? fopen(journalPath.c_str(), "wb") : nullptr;
+    if (!file) {
+        std::cerr << "Unable to write the edit journal " << journalPath << std::endl;
+        journalLock.reset();
+        return;
+    }
+    fwrite(JournalMagic, 1, sizeof(JournalMagic), file);
+    fflush(file);
+    journalFilePath = journalPath;
+    journalLayerIds.clear();
+    journalStopRequested = false;
+    journalEnabled = true;
+    journalSaveListener.reset(new JournalSaveListener());
+    journalThread = std::thread([file]() {
+        WriteJournal(file);
+        fclose(file);
+    });
+}
+
+void StopEditJournal(bool removeJournal) {
+    if (!journalEnabled) {
+        return;
+    }
+    journalEnabled = false;
+    journalSaveListener.reset();
+    {
+        std::lock_guard<std::mutex> lock(journalMutex);
+        journalStopRequested = true;
+    }
+    journalCondition.notify_one();
+    journalThread.join();
+    if (removeJournal) {
+        TfDeleteFile(journalFilePath);
+    }
+    journalLock.reset();
+    journalFilePath.clear();
+}
+
+void JournalSetField(const SdfLayerHandle &layer, const SdfPath &path, const TfToken &fieldName, const VtValue &value) {
+    if (journalEnabled && layer) {
+        JournalEntry entry{JournalRecord::SetField};
+        entry.layerId = GetJournalLayerId(layer);
+        entry.path = path;
+        entry.fieldName = fieldName;
+        entry.value = value;
+        QueueEntry(std::move(entry));
+    }
+}
+
+void JournalSetFieldDictValueByKey(const SdfLayerHandle &layer, const SdfPath &path, const TfToken &fieldName,
+                                   const TfToken &keyPath, const VtValue &value) {
+    if (journalEnabled && layer) {
+        JournalEntry entry{JournalRecord::SetFieldDictValueByKey};
+        entry.layerId = GetJournalLayerId(layer);
+        entry.path = path;
+        entry.fieldName = fieldName;
+        entry.tokenValue = keyPath;
+        entry.value = value;
+        QueueEntry(std::move(entry));
+    }
+}
+
+void JournalSetTimeSample(const SdfLayerHandle &layer, const SdfPath &path, double timeCode, const VtValue &value) {
+    if (journalEnabled && layer) {
+        JournalEntry entry{JournalRecord::SetTimeSample};
+        entry.layerId = GetJournalLayerId(layer);
+        entry.path = path;
+        entry.timeCode = timeCode;
+        entry.value = value;
+        QueueEntry(std::move(entry));
+    }
+}
+
+static void JournalSpec(JournalRecord record, const SdfLayerHandle &layer, const SdfPath &path, SdfSpecType specType, bool inert) {
+    if (journalEnabled && layer) {
+        JournalEntry entry{record};
+        entry.layerId = GetJournalLayerId(layer);
+        entry.path = path;
+        entry.specType = specType;
+        entry.inert = inert;
+        QueueEntry(std::move(entry));
+    }
+}
+
+void JournalCreateSpec(const SdfLayerHandle &layer, const SdfPath &path, SdfSpecType specType, bool inert) {
+    JournalSpec(JournalRecord::CreateSpec, layer, path, specType, inert);
+}
+
+void JournalDeleteSpec(const SdfLayerHandle &layer, const SdfPath &path, bool inert) {
+    JournalSpec(JournalRecord::DeleteSpec, layer, path, SdfSpecTypeUnknown, inert);
+}
+
+static void JournalPathOperation(JournalRecord record, const SdfLayerHandle &layer, const SdfPath &path,
+                                 const TfToken &fieldName, const TfToken &tokenValue, const SdfPath &pathValue) {
+    if (journalEnabled && layer) {
+        JournalEntry entry{record};
+        entry.layerId = GetJournalLayerId(layer);
+        entry.path = path;
+        entry.fieldName = fieldName;
+        entry.tokenValue = tokenValue;
+        entry.pathValue = pathValue;
+        QueueEntry(std::move(entry));
+    }
+}
+
+void JournalMoveSpec(const SdfLayerHandle &layer, const SdfPath &oldPath, const SdfPath &newPath) {
+    JournalPathOperation(JournalRecord::MoveSpec, layer, oldPath, TfToken(), TfToken(), newPath);
+}
+
+void JournalPushChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const TfToken &value) {
+    JournalPathOperation(JournalRecord::PushChildToken, layer, parentPath, fieldName, value, SdfPath());
+}
+
+void JournalPushChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const SdfPath &value) {
+    JournalPathOperation(JournalRecord::PushChildPath, layer, parentPath, fieldName, TfToken(), value);
+}
+
+void JournalPopChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const TfToken &value) {
+    JournalPathOperation(JournalRecord::PopChildToken, layer, parentPath, fieldName, value, SdfPath());
+}
+
+void JournalPopChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const SdfPath &value) {
+    JournalPathOperation(JournalRecord::PopChildPath, layer, parentPath, fieldName, TfToken(), value);
+}
+
+static void JournalMarker(JournalRecord record) {
+    if (journalEnabled) {
+        QueueEntry(JournalEntry{record});
+    }
+}
+
+void JournalCommit() { JournalMarker(JournalRecord::Commit); }
+void JournalUndo() { JournalMarker(JournalRecord::Undo); }
+void JournalRedo() { JournalMarker(JournalRecord::Redo); }
+
+///
+/// Reading and replay
+///
+
+static bool ReadJournalFile(const std::string &journalPath, std::string &content) {
+    std::ifstream file(journalPath, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return content.size() >= sizeof(JournalMagic) && content.compare(0, sizeof(JournalMagic), JournalMagic, sizeof(JournalMagic)) == 0;
+}
+
+/// Reads all the complete entries of the journal
+static std::vector<JournalEntry> ReadJournalEntries(const std::string &journalPath) {
+    std::vector<JournalEntry> entries;
+    std::string content;
+    if (!ReadJournalFile(journalPath, content)) {
+        return entries;
+    }
+    JournalInputStream in(content.data() + sizeof(JournalMagic), content.data() + content.size());
+    uint32_t recordSize = 0;
+    while (in.ReadPod(recordSize) && static_cast<size_t>(in.end - in.cursor) >= recordSize) {
+        JournalInputStream record(in.cursor, in.cursor + recordSize);
+        in.cursor += recordSize;
+        JournalEntry entry{JournalRecord::Commit};
+        if (!DecodeEntry(record, entry)) {
+            break; // Corrupted journal, stop here
+        }
+        entries.emplace_back(std::move(entry));
+    }
+    return entries;
+}
+
+bool EditJournalExists(const std::string &journalPath) {
+    return ArchGetFileLength(journalPath.c_str()) > static_cast<int64_t>(sizeof(JournalMagic));
+}
+
+/// Apply an operation through the layer state delegate, as the undo/redo instructions do
+static void ApplyJournalEntry(const SdfLayerRefPtr &layer, const JournalEntry &entry) {
+    SdfLayerStateDelegateBaseRefPtr delegate = layer->GetStateDelegate();
+    switch (entry.record) {
+    case JournalRecord::SetField:
+        delegate->SetField(entry.path, entry.fieldName, entry.value);
+        break;
+    case JournalRecord::SetFieldDictValueByKey:
+        delegate->SetFieldDictValueByKey(entry.path, entry.fieldName, entry.tokenValue, entry.value);
+        break;
+    case JournalRecord::SetTimeSample:
+        delegate->SetTimeSample(entry.path, entry.timeCode, entry.value);
+        break;
+    case JournalRecord::CreateSpec:
+        delegate->CreateSpec(entry.path, entry.specType, entry.inert);
+        break;
+    case JournalRecord::DeleteSpec:
+        delegate->DeleteSpec(entry.path, entry.inert);
+        break;
+    case JournalRecord::MoveSpec:
+        delegate->MoveSpec(entry.path, entry.pathValue);
+        break;
+    case JournalRecord::PushChildToken:
+        delegate->PushChild(entry.path, entry.fieldName, entry.tokenValue);
+        break;
+    case JournalRecord::PushChildPath:
+        delegate->PushChild(entry.path, entry.fieldName, entry.pathValue);
+        break;
+    case JournalRecord::PopChildToken:
+        delegate->PopChild(entry.path, entry.fieldName, entry.tokenValue);
+        break;
+    case JournalRecord::PopChildPath:
+        delegate->PopChild(entry.path, entry.fieldName, entry.pathValue);
+        break;
+    default:
+        break;
+    }
+}
+
+EditJournalReplayReport ReplayEditJournal(const std::string &journalPath, const ApplyJournalCommandFunc &applyCommand) {
+    EditJournalReplayReport report;
+
+    struct ReplayLayer {
+        std::string identifier;
+        std::string realPath;
+        uint64_t checksum = 0;
+        int undoneSaves = 0;   // Saved commands which were undone, the file contains edits which are not in memory
+        bool unrecoverable = false;
+    };
+    struct ReplayCommand {
+        std::vector<JournalEntry> operations;
+        std::set<uint32_t> savedLayers; // Layers whose operations in this command were saved
+    };
+    std::map<uint32_t, ReplayLayer> layers;
+    std::vector<ReplayCommand> commands;
+    size_t position = 0; // Same as undoStackPos
+    ReplayCommand pending;
+
+    auto truncateHistory = [&]() {
+        for (size_t i = position; i < commands.size(); ++i) {
+            for (const auto layerId : commands[i].savedLayers) {
+                layers[layerId].unrecoverable = true;
+            }
+        }
+        commands.resize(position);
+    };
+
+    // Rebuild the history as it was when the journal stopped
+    for (auto &entry : ReadJournalEntries(journalPath)) {
+        switch (entry.record) {
+        case JournalRecord::Layer: {
+            ReplayLayer &layer = layers[entry.layerId];
+            layer.identifier = entry.identifier;
+            layer.realPath = entry.realPath;
+            layer.checksum = entry.checksum;
+            break;
+        }
+        case JournalRecord::LayerSaved: {
+            // The active operations on this layer are in the file now
+            layers[entry.layerId].checksum = entry.checksum;
+            auto isOnSavedLayer = [&entry](const JournalEntry &operation) { return operation.layerId == entry.layerId; };
+            for (size_t i = 0; i < position; ++i) {
+                auto &operations = commands[i].operations;
+                const auto removed = std::remove_if(operations.begin(), operations.end(), isOnSavedLayer);
+                if (removed != operations.end()) {
+                    operations.erase(removed, operations.end());
+                    commands[i].savedLayers.insert(entry.layerId);
+                }
+            }
+            auto &operations = pending.operations;
+            operations.erase(std::remove_if(operations.begin(), operations.end(), isOnSavedLayer), operations.end());
+            break;
+        }
+        case JournalRecord::Commit:
+            truncateHistory();
+            commands.emplace_back(std::move(pending));
+            pending = ReplayCommand();
+            position++;
+            break;
+        case JournalRecord::Undo:
+            if (position > 0) {
+                position--;
+                for (const auto layerId : commands[position].savedLayers) {
+                    layers[layerId].undoneSaves++;
+                }
+            }
+            break;
+        case JournalRecord::Redo:
+            if (position < commands.size()) {
+                for (const auto layerId : commands[position].savedLayers) {
+                    layers[layerId].undoneSaves--;
+                }
+                position++;
+            }
+            break;
+        default:
+            pending.operations.emplace_back(std::move(entry));
+            break;
+        }
+    }
+    // Operations journaled after the last commit
+    if (!pending.operations.empty()) {
+        truncateHistory();
+        commands.emplace_back(std::move(pending));
+        position++;
+    }
+
+    // Open the layers and check they are in the same state as when the edits were journaled
+    std::map<uint32_t, SdfLayerRefPtr> openedLayers;
+    for (auto &layer : layers) {
+        const ReplayLayer &replayLayer = layer.second;
+        if (replayLayer.realPath.empty()) {
+            report.skipped.push_back(replayLayer.identifier + ": anonymous layer");
+        } else if (replayLayer.unrecoverable || replayLayer.undoneSaves > 0) {
+            report.skipped.push_back(replayLayer.identifier + ": saved edits were undone");
+        } else if (ComputeFileChecksum(replayLayer.realPath) != replayLayer.checksum) {
+            report.skipped.push_back(replayLayer.identifier + ": the file has changed");
+        } else if (SdfLayerRefPtr sdfLayer = SdfLayer::FindOrOpen(replayLayer.identifier)) {
+            openedLayers[layer.first] = sdfLayer;
+        } else {
+            report.skipped.push_back(replayLayer.identifier + ": unable to open the layer");
+        }
+    }
+
+    // Replay the active commands, one command per layer
+    for (size_t i = 0; i < position; ++i) {
+        std::map<uint32_t, std::vector<const JournalEntry *>> operationsPerLayer;
+        for (const auto &operation : commands[i].operations) {
+            if (openedLayers.count(operation.layerId) && operation.isValueSupported) {
+                operationsPerLayer[operation.layerId].push_back(&operation);
+            } else {
+                report.numSkippedOperations++;
+            }
+        }
+        for (const auto &layerOperations : operationsPerLayer) {
+            SdfLayerRefPtr layer = openedLayers[layerOperations.first];
+            applyCommand(layer, [&]() {
+                SdfChangeBlock block;
+                for (const auto operation : layerOperations.second) {
+                    ApplyJournalEntry(layer, *operation);
+                }
+            });
+            report.numOperations += layerOperations.second.size();
+        }
+        if (!operationsPerLayer.empty()) {
+            report.numCommands++;
+        }
+    }
+    for (const auto &layer : openedLayers) {
+        report.layers.push_back(layer.second);
+    }
+    return report;
+}
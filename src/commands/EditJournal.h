@@ -0,0 +1,75 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/path.h>
+#include <pxr/usd/sdf/types.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// Append only journal of the edits, used to recover the unsaved work when usdtweak crashes.
+///
+/// The low level Sdf operations recorded by UndoRedoLayerStateDelegate are queued by the ui thread and written
+/// in batches by a background thread. The journal also contains the command boundaries and the undo/redo, so the
+/// history can be rebuilt when replaying, and for each layer its identifier and a checksum of its file when it was
+/// first edited or saved.
+/// The journal is removed when the application exits normally. Each process writes its own journal and holds a lock
+/// on it, so a journal found without its lock was left by a session which didn't exit cleanly.
+///
+
+/// Directory of the journals of the current user
+std::string GetEditJournalDirectory();
+
+/// Start writing the journal of this process in journalDirectory
+void StartEditJournal(const std::string &journalDirectory);
+
+/// Flush the remaining entries and stop the writing thread. The journal file is removed if removeJournal is true
+void StopEditJournal(bool removeJournal);
+
+/// Sdf operations, called by the layer state delegate before the operation is applied
+void JournalSetField(const SdfLayerHandle &layer, const SdfPath &path, const TfToken &fieldName, const VtValue &value);
+void JournalSetFieldDictValueByKey(const SdfLayerHandle &layer, const SdfPath &path, const TfToken &fieldName,
+                                   const TfToken &keyPath, const VtValue &value);
+void JournalSetTimeSample(const SdfLayerHandle &layer, const SdfPath &path, double timeCode, const VtValue &value);
+void JournalCreateSpec(const SdfLayerHandle &layer, const SdfPath &path, SdfSpecType specType, bool inert);
+void JournalDeleteSpec(const SdfLayerHandle &layer, const SdfPath &path, bool inert);
+void JournalMoveSpec(const SdfLayerHandle &layer, const SdfPath &oldPath, const SdfPath &newPath);
+void JournalPushChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const TfToken &value);
+void JournalPushChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const SdfPath &value);
+void JournalPopChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const TfToken &value);
+void JournalPopChild(const SdfLayerHandle &layer, const SdfPath &parentPath, const TfToken &fieldName, const SdfPath &value);
+
+/// A command was pushed on the undo stack, the operations journaled since the previous commit belong to it
+void JournalCommit();
+
+/// The last command was undone or redone
+void JournalUndo();
+void JournalRedo();
+
+/// Returns true if a journal with at least one entry exists at journalPath
+bool EditJournalExists(const std::string &journalPath);
+
+/// Find the most recent journal with entries left in journalDirectory by a crashed session. Its lock is taken by this
+/// process until it is removed, returns an empty string if there is none
+std::string ClaimCrashedEditJournal(const std::string &journalDirectory);
+
+/// Remove a journal returned by ClaimCrashedEditJournal and release its lock
+void RemoveCrashedEditJournal(const std::string &journalPath);
+
+/// What happened when replaying a journal
+struct EditJournalReplayReport {
+    size_t numCommands = 0;           // Commands replayed
+    size_t numOperations = 0;         // Operations replayed
+    size_t numSkippedOperations = 0;  // Operations on skipped layers or with values that couldn't be stored
+    SdfLayerRefPtrVector layers;      // Layers modified by the replay
+    std::vector<std::string> skipped; // Skipped layers with the reason
+};
+
+/// Function applying a command of the journal on a layer, it is expected to record the command in the undo stack
+using ApplyJournalCommandFunc = std::function<void(SdfLayerRefPtr, const std::function<void()> &)>;
+
+/// Replay the journal on the layers. The layers are opened if needed and skipped if they are anonymous or if their
+/// file changed since the edits were journaled
+EditJournalReplayReport ReplayEditJournal(const std::string &journalPath, const ApplyJournalCommandFunc &applyCommand);
@@ -162,3 +162,63 @@ struct EditorSetNextLayer : public EditorCommand {
 };
 template void ExecuteAfterDraw<EditorSetNextLayer>();
 
+/// Queue the payloads of the prim and its descendants in the background loader
+struct EditorLoadPayload : public EditorCommand {
+
+    EditorLoadPayload(UsdPrim prim) : _prim(std::move(prim)) {}
+    ~EditorLoadPayload() override {}
+
+    bool DoIt() override {
+        if (_editor && _prim) {
+            _editor->GetPayloadLoader().Load(_prim);
+        }
+        return false;
+    }
+    UsdPrim _prim;
+};
+template void ExecuteAfterDraw<EditorLoadPayload>(UsdPrim prim);
+
+struct EditorUnloadPayload : public EditorCommand {
+
+    EditorUnloadPayload(UsdPrim prim) : _prim(std::move(prim)) {}
+    ~EditorUnloadPayload() override {}
+
+    bool DoIt() override {
+        if (_editor && _prim) {
+            _editor->GetPayloadLoader().Unload(_prim);
+        }
+        return false;
+    }
+    UsdPrim _prim;
+};
+template void ExecuteAfterDraw<EditorUnloadPayload>(UsdPrim prim);
+
+/// Apply the payloads loaded in the background to the stages. Loading is not an edit, there is no undo
+struct EditorCommitPayloads : public EditorCommand {
+
+    EditorCommitPayloads() {}
+    ~EditorCommitPayloads() override {}
+
+    bool DoIt() override {
+        if (_editor) {
+            _editor->GetPayloadLoader().Commit();
+        }
+        return false;
+    }
+};
+template void ExecuteAfterDraw<EditorCommitPayloads>();
+
+struct EditorShowLayerDiff : public EditorCommand {
+
+    EditorShowLayerDiff(SdfLayerHandle layer) : _layer(layer) {}
+    ~EditorShowLayerDiff() override {}
+
+    bool DoIt() override {
+        if (_editor && _layer) {
+            _editor->ShowLayerDiff(_layer);
+        }
+        return false;
+    }
+    SdfLayerHandle _layer;
+};
+template void ExecuteAfterDraw<EditorShowLayerDiff>(SdfLayerHandle layer);
@@ -3,6 +3,7 @@
 /// IT SHOULD NOT BE COMPILED SEPARATELY
 ///
 
+#include <pxr/usd/sdf/changeBlock.h>
 #include <pxr/usd/sdf/layer.h>
 #include <pxr/usd/sdf/primSpec.h>
 #include <pxr/usd/sdf/variantSpec.h>
@@ -18,11 +19,15 @@ PXR_NAMESPACE_USING_DIRECTIVE
 struct PrimNew : public SdfLayerCommand {
 
     // Create a root prim
-    PrimNew(SdfLayerRefPtr layer, std::string primName) : _primSpec(), _layer(layer), _primName(std::move(primName)) {}
+    PrimNew(SdfLayerRefPtr layer, std::string primName) : _primSpec(), _layer(layer), _primNames{std::move(primName)} {}
 
     // Create a child prim
     PrimNew(SdfPrimSpecHandle primSpec, std::string primName)
-        : _primSpec(std::move(primSpec)), _layer(), _primName(std::move(primName)) {}
+        : _primSpec(std::move(primSpec)), _layer(), _primNames{std::move(primName)} {}
+
+    // Create many child prims at once, a single undo
+    PrimNew(SdfPrimSpecHandle primSpec, std::vector<std::string> primNames)
+        : _primSpec(std::move(primSpec)), _layer(), _primNames(std::move(primNames)) {}
 
     ~PrimNew() override {}
 
@@ -31,20 +36,26 @@ struct PrimNew : public SdfLayerCommand {
             return false;
         if (_layer) {
             SdfUndoRecorder recorder(_undoCommands, _layer);
-            _newPrimSpec = SdfPrimSpec::New(_layer, _primName, SdfSpecifier::SdfSpecifierDef);
-            _layer->InsertRootPrim(_newPrimSpec);
+            for (const auto &primName : _primNames) {
+                _newPrimSpec = SdfPrimSpec::New(_layer, primName, SdfSpecifier::SdfSpecifierDef);
+                _layer->InsertRootPrim(_newPrimSpec);
+            }
             return true;
         } else {
             SdfUndoRecorder recorder(_undoCommands, _primSpec->GetLayer());
-            _newPrimSpec = SdfPrimSpec::New(_primSpec, _primName, SdfSpecifier::SdfSpecifierDef);
+            // One notice for all the new prims
+            SdfChangeBlock changeBlock;
+            for (const auto &primName : _primNames) {
+                _newPrimSpec = SdfPrimSpec::New(_primSpec, primName, SdfSpecifier::SdfSpecifierDef);
+            }
             return true;
         }
     }
 
-    SdfPrimSpecHandle _newPrimSpec;
+    SdfPrimSpecHandle _newPrimSpec; // The last one created
     SdfPrimSpecHandle _primSpec;
     SdfLayerRefPtr _layer;
-    std::string _primName;
+    std::vector<std::string> _primNames;
 };
 
 struct PrimRemove : public SdfLayerCommand {
@@ -186,6 +197,7 @@ struct PrimCreateAttribute : public SdfLayerCommand {
 /// TODO: how to avoid having to write the argument list ? it's the same as the constructor arguments
 template void ExecuteAfterDraw<PrimNew>(SdfLayerRefPtr layer, std::string newName);
 template void ExecuteAfterDraw<PrimNew>(SdfPrimSpecHandle primSpec, std::string newName);
+template void ExecuteAfterDraw<PrimNew>(SdfPrimSpecHandle primSpec, std::vector<std::string> newNames);
 template void ExecuteAfterDraw<PrimRemove>(SdfPrimSpecHandle primSpec);
 template void ExecuteAfterDraw<PrimReparent>(SdfLayerHandle layer, SdfPath source, SdfPath destination);
 template void ExecuteAfterDraw<PrimCreateReference>(SdfPrimSpecHandle primSpec, int operation, SdfReference reference);
@@ -1,4 +1,5 @@
 #include <boost/range/adaptor/reversed.hpp> // why reverse adaptor is not in std ?? seriously ...
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include "SdfCommandGroup.h"
@@ -6,9 +7,30 @@
 
 
 
+// Number of time samples edited on the same attribute before switching to a range instruction
+static constexpr size_t TimeSamplesRangeThreshold = 16;
+
 bool SdfCommandGroup::IsEmpty() const { return _instructions.empty(); }
 
-void SdfCommandGroup::Clear() { _instructions.clear(); }
+void SdfCommandGroup::Clear() {
+    _instructions.clear();
+    _timeSamplesRuns.clear();
+}
+
+size_t SdfCommandGroup::GetNumInstructions() const {
+    return std::count_if(_instructions.begin(), _instructions.end(), [](const InstructionWrapper &inst) { return !inst.IsEmpty(); });
+}
+
+bool SdfCommandGroup::HasTimeSamplesRange(const SdfLayerHandle &layer, const SdfPath &path) const {
+    const auto run = _timeSamplesRuns.find({get_pointer(layer), path});
+    return run != _timeSamplesRuns.end() && run->second.isRange;
+}
+
+void SdfCommandGroup::_InvalidateTimeSamplesRuns(const UndoRedoSetField &inst) {
+    if (inst._fieldName == SdfFieldKeys->TimeSamples) {
+        _timeSamplesRuns.erase({get_pointer(inst._layer), inst._path});
+    }
+}
 
 template <typename InstructionT>
 void SdfCommandGroup::StoreInstruction(InstructionT inst) {
@@ -17,13 +39,59 @@ void SdfCommandGroup::StoreInstruction(InstructionT inst) {
     // One optim would be to look for the previous instruction, check if it is a setfield on the same path, same layer ?
     // Update the latest instruction instead of inserting a new instruction
     // As StoreInstruction is templatized, it is possible to specialize it.
+    _InvalidateTimeSamplesRuns(inst);
     _instructions.emplace_back(std::move(inst));
 }
 
+// Scripted retiming or key baking sets thousands of samples on the same attribute. Past the threshold,
+// the individual instructions are replaced by a single one restoring the whole samples map
+template <>
+void SdfCommandGroup::StoreInstruction<UndoRedoSetTimeSample>(UndoRedoSetTimeSample inst) {
+    TimeSamplesRun &run = _timeSamplesRuns[{get_pointer(inst._layer), inst._path}];
+    if (run.isRange) {
+        return; // Already covered by the range instruction
+    }
+    if (run.instructions.empty()) {
+        run.hadTimeSamples = inst._layer->HasField(inst._path, SdfFieldKeys->TimeSamples);
+    }
+    if (run.instructions.size() < TimeSamplesRangeThreshold) {
+        run.instructions.push_back(_instructions.size());
+        run.previousValues.emplace_back(inst._timeCode, inst._previousValue);
+        _instructions.emplace_back(std::move(inst));
+        return;
+    }
+
+    // The edits of the run are already applied on the layer, rebuild the samples map as it was before the first one
+    VtValue previousSamples;
+    if (run.hadTimeSamples) {
+        VtValue currentSamples;
+        SdfTimeSampleMap samples;
+        if (inst._layer->HasField(inst._path, SdfFieldKeys->TimeSamples, &currentSamples) &&
+            currentSamples.IsHolding<SdfTimeSampleMap>()) {
+            currentSamples.Swap(samples);
+        }
+        for (auto it = run.previousValues.rbegin(); it != run.previousValues.rend(); ++it) {
+            if (it->second.IsEmpty()) {
+                samples.erase(it->first);
+            } else {
+                samples[it->first] = it->second;
+            }
+        }
+        previousSamples = VtValue::Take(samples);
+    }
+
+    // The range instruction takes the place of the first edit, the others are emptied
+    _instructions[run.instructions.front()] =
+        InstructionWrapper(UndoRedoSetTimeSamples(inst._layer, inst._path, std::move(previousSamples)));
+    for (size_t i = 1; i < run.instructions.size(); ++i) {
+        _instructions[run.instructions[i]].Clear();
+    }
+    run = TimeSamplesRun();
+    run.isRange = true;
+}
 
 template void SdfCommandGroup::StoreInstruction<UndoRedoSetField>(UndoRedoSetField inst);
 template void SdfCommandGroup::StoreInstruction<UndoRedoSetFieldDictValueByKey>(UndoRedoSetFieldDictValueByKey inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoSetTimeSample>(UndoRedoSetTimeSample inst);
 template void SdfCommandGroup::StoreInstruction<UndoRedoCreateSpec>(UndoRedoCreateSpec inst);
 template void SdfCommandGroup::StoreInstruction<UndoRedoDeleteSpec>(UndoRedoDeleteSpec inst);
 template void SdfCommandGroup::StoreInstruction<UndoRedoMoveSpec>(UndoRedoMoveSpec inst);
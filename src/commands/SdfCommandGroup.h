@@ -1,8 +1,20 @@
 #pragma once
 #include <vector>
 #include <functional>
+#include <map>
 #include <memory>
 #include <iostream>
+#include <utility>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/path.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+struct UndoRedoSetField;
+struct UndoRedoSetTimeSample;
+struct UndoRedoCreateSpec;
+struct UndoRedoDeleteSpec;
+struct UndoRedoMoveSpec;
 
 
 class InstructionWrapper {
@@ -15,17 +27,27 @@ public:
     }
 
     void DoIt() {
-        _ref->DoIt();
+        if (_ref) {
+            _ref->DoIt();
+        }
     }
 
     void UndoIt() {
-        _ref->UndoIt();
+        if (_ref) {
+            _ref->UndoIt();
+        }
     }
 
     void ShowIt() {
-        _ref->ShowIt();
+        if (_ref) {
+            _ref->ShowIt();
+        }
     }
 
+    /// Remove the instruction, the wrapper stays in place and does nothing
+    void Clear() { _ref.reset(); }
+    bool IsEmpty() const { return !_ref; }
+
     struct Interface {
         virtual ~Interface() = default;
         virtual void DoIt() = 0;
@@ -63,6 +85,9 @@ public:
     bool IsEmpty() const;
     void Clear();
 
+    /// Number of recorded instructions
+    size_t GetNumInstructions() const;
+
     /// Run the commands as an undo
     void DoIt();
     void UndoIt();
@@ -70,8 +95,32 @@ public:
     template <typename InstructionT>
     void StoreInstruction(InstructionT);
 
+    /// Returns true when the time samples of this attribute are already recorded as a whole range in this group,
+    /// the following SetTimeSample on the attribute don't need to be recorded
+    bool HasTimeSamplesRange(const SdfLayerHandle &layer, const SdfPath &path) const;
+
 private:
+    // Time samples edited on the same attribute. Above a threshold the individual instructions are replaced by one
+    // instruction restoring the whole time samples map
+    struct TimeSamplesRun {
+        std::vector<size_t> instructions; // positions of the UndoRedoSetTimeSample in _instructions
+        std::vector<std::pair<double, VtValue>> previousValues;
+        bool hadTimeSamples = false;
+        bool isRange = false;
+    };
+    using TimeSamplesRunKey = std::pair<const SdfLayer *, SdfPath>;
+
+    // Edits which invalidate the runs of time samples
+    template <typename InstructionT> void _InvalidateTimeSamplesRuns(const InstructionT &) {}
+    void _InvalidateTimeSamplesRuns(const UndoRedoSetField &inst);
+    void _InvalidateTimeSamplesRuns(const UndoRedoCreateSpec &) { _timeSamplesRuns.clear(); }
+    void _InvalidateTimeSamplesRuns(const UndoRedoDeleteSpec &) { _timeSamplesRuns.clear(); }
+    void _InvalidateTimeSamplesRuns(const UndoRedoMoveSpec &) { _timeSamplesRuns.clear(); }
+
     std::vector<InstructionWrapper> _instructions;
+    std::map<TimeSamplesRunKey, TimeSamplesRun> _timeSamplesRuns;
 };
 
+template <> void SdfCommandGroup::StoreInstruction<UndoRedoSetTimeSample>(UndoRedoSetTimeSample);
+
 
@@ -36,7 +36,7 @@ struct UndoRedoSetField {
 
 struct UndoRedoSetFieldDictValueByKey {
     UndoRedoSetFieldDictValueByKey(SdfLayerHandle layer, const SdfPath &path, const TfToken& fieldName, const TfToken& keyPath, VtValue value, VtValue previousValue)
-        :_layer(layer), _path(path), _fieldName(fieldName), _keyPath(keyPath), _newValue(std::move(value)), _previousValue(previousValue) {}
+        :_layer(layer), _path(path), _fieldName(fieldName), _keyPath(keyPath), _newValue(std::move(value)), _previousValue(std::move(previousValue)) {}
 
     UndoRedoSetFieldDictValueByKey(UndoRedoSetFieldDictValueByKey &&) = default;
     ~UndoRedoSetFieldDictValueByKey() = default;
@@ -97,6 +97,34 @@ struct UndoRedoSetTimeSample {
     VtValue _previousValue;
 };
 
+/// Restores all the time samples of an attribute, it replaces a long run of UndoRedoSetTimeSample in a command.
+/// The new samples are captured when undoing, at this point the layer contains all the edits of the run.
+struct UndoRedoSetTimeSamples {
+    UndoRedoSetTimeSamples(SdfLayerHandle layer, const SdfPath &path, VtValue previousSamples)
+        : _layer(layer), _path(path), _previousSamples(std::move(previousSamples)) {}
+    ~UndoRedoSetTimeSamples() = default;
+    UndoRedoSetTimeSamples(UndoRedoSetTimeSamples &&) = default;
+
+    void DoIt() {
+        if (_layer && _layer->GetStateDelegate()) {
+            _layer->GetStateDelegate()->SetField(_path, SdfFieldKeys->TimeSamples, _newSamples);
+        }
+    }
+
+    void UndoIt() {
+        if (_layer && _layer->GetStateDelegate()) {
+            _newSamples = VtValue();
+            _layer->HasField(_path, SdfFieldKeys->TimeSamples, &_newSamples);
+            _layer->GetStateDelegate()->SetField(_path, SdfFieldKeys->TimeSamples, _previousSamples);
+        }
+    }
+
+    SdfLayerRefPtr _layer;
+    const SdfPath _path;
+    VtValue _newSamples;
+    VtValue _previousSamples;
+};
+
 struct UndoRedoCreateSpec {
     UndoRedoCreateSpec(SdfLayerHandle layer, const SdfPath& path, SdfSpecType specType, bool inert)
         : _layer(layer), _path(path), _specType(specType), _inert(inert) {}
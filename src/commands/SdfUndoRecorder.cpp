@@ -3,17 +3,13 @@
 #include "UndoLayerStateDelegate.h"
 
 SdfUndoRecorder::SdfUndoRecorder(SdfCommandGroup &undoCommands, SdfLayerRefPtr layer)
-    : _undoCommands(undoCommands), _layer(layer) {
-    if (_layer) {
-        _previousDelegate = _layer->GetStateDelegate();
-        if (undoCommands.IsEmpty()) { // No undo commands were previously recorded
-            _layer->SetStateDelegate(UndoRedoLayerStateDelegate::New(undoCommands));
-        }
+    : _previousCommands(GetRecordingCommandGroup()) {
+    InstallUndoRedoDelegate(layer);
+    if (undoCommands.IsEmpty()) { // No undo commands were previously recorded
+        SetRecordingCommandGroup(&undoCommands);
     }
 }
 
 SdfUndoRecorder::~SdfUndoRecorder() {
-    if (_layer && _previousDelegate) {
-        _layer->SetStateDelegate(_previousDelegate);
-    }
+    SetRecordingCommandGroup(_previousCommands);
 }
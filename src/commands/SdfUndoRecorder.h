@@ -7,7 +7,8 @@
 PXR_NAMESPACE_USING_DIRECTIVE
 
 ///
-/// Scoped undo recorder
+/// Scoped undo recorder. The edits of all the layers having the undo/redo delegate are recorded in undoCommands,
+/// the delegate is installed on the layer if needed.
 ///
 
 class SdfUndoRecorder final {
@@ -18,9 +19,7 @@ public:
     ~SdfUndoRecorder();
 
 private:
-    SdfCommandGroup &_undoCommands;
-    SdfLayerRefPtr _layer;
-    SdfLayerStateDelegateBaseRefPtr _previousDelegate;
+    SdfCommandGroup *_previousCommands;
 };
 
 
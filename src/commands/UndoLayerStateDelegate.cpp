@@ -1,9 +1,11 @@
 #include <iostream>
 #include <pxr/usd/sdf/path.h>
 #include <pxr/usd/sdf/abstractData.h>
+#include <pxr/usd/usd/notice.h>
 #include "UndoLayerStateDelegate.h"
 #include "SdfUndoRecorder.h"
 #include "SdfLayerInstructions.h"
+#include "EditJournal.h"
 
 ///
 /// UndoRedoLayerStateDelegate is a delegate used to record Undo functions.
@@ -29,21 +31,58 @@
 
 // TODO: We must have Unit tests for this part of the software !
 
+/// Command group receiving the edits of all the layers
+static SdfCommandGroup *recordingCommandGroup = nullptr;
+
+void SetRecordingCommandGroup(SdfCommandGroup *commandGroup) { recordingCommandGroup = commandGroup; }
+
+SdfCommandGroup *GetRecordingCommandGroup() { return recordingCommandGroup; }
+
+void InstallUndoRedoDelegate(const SdfLayerHandle &layer) {
+    if (layer && !TfDynamic_cast<UndoRedoLayerStateDelegatePtr>(layer->GetStateDelegate())) {
+        // SetStateDelegate keeps the dirty state of the layer
+        layer->SetStateDelegate(UndoRedoLayerStateDelegate::New());
+    }
+}
+
+/// Installs the delegate on the layers loaded by the stages after InstallUndoRedoDelegates was called.
+/// A new layer in a stage always comes with a resync
+class UndoRedoDelegateInstaller : public TfWeakBase {
+  public:
+    UndoRedoDelegateInstaller() {
+        TfNotice::Register(TfCreateWeakPtr(this), &UndoRedoDelegateInstaller::OnObjectsChanged);
+    }
+
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+        if (!notice.GetResyncedPaths().empty() && notice.GetStage()) {
+            for (const auto &layer : notice.GetStage()->GetUsedLayers()) {
+                InstallUndoRedoDelegate(layer);
+            }
+        }
+    }
+};
+
+void InstallUndoRedoDelegates(const UsdStageRefPtr &stage) {
+    static UndoRedoDelegateInstaller installer;
+    if (stage) {
+        for (const auto &layer : stage->GetUsedLayers()) {
+            InstallUndoRedoDelegate(layer);
+        }
+    }
+}
+
 void UndoMarkStateAsDirty(SdfLayerHandle layer) {
-    if (layer && layer->GetStateDelegate()) {
+    if (layer) {
         // TODO: investigate why the following code does not reset the dirty flag
-        SdfLayerStateDelegateBaseRefPtr previousDelegate = layer->GetStateDelegate();
-        SdfCommandGroup dummyCommands;
-        auto stateDelegate = UndoRedoLayerStateDelegate::New(dummyCommands);
-        layer->SetStateDelegate(stateDelegate);
-        stateDelegate->SetClean();
-        layer->SetStateDelegate(previousDelegate);
+        if (auto stateDelegate = TfDynamic_cast<UndoRedoLayerStateDelegatePtr>(layer->GetStateDelegate())) {
+            stateDelegate->SetClean();
+        }
     }
 }
 
-UndoRedoLayerStateDelegateRefPtr UndoRedoLayerStateDelegate::New(SdfCommandGroup &instructions)
+UndoRedoLayerStateDelegateRefPtr UndoRedoLayerStateDelegate::New()
 {
-    return TfCreateRefPtr(new UndoRedoLayerStateDelegate(instructions));
+    return TfCreateRefPtr(new UndoRedoLayerStateDelegate());
 }
 
 void UndoRedoLayerStateDelegate::SetClean() {
@@ -89,9 +128,14 @@ UndoRedoLayerStateDelegate::_OnSetField(
     const VtValue& value)
 {
     SetDirty();
-    const VtValue previousValue = _layer->GetField(path, fieldName);
-    const VtValue newValue = value;
-    _undoCommands.StoreInstruction<UndoRedoSetField>({_layer, path, fieldName, newValue, previousValue});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalSetField(_layer, path, fieldName, value);
+    VtValue previousValue;
+    _layer->HasField(path, fieldName, &previousValue);
+    undoCommands->StoreInstruction<UndoRedoSetField>({_layer, path, fieldName, value, std::move(previousValue)});
 }
 
 void
@@ -101,10 +145,18 @@ UndoRedoLayerStateDelegate::_OnSetField(
     const SdfAbstractDataConstValue& value)
 {
     SetDirty();
-    const VtValue previousValue = _layer->GetField(path, fieldName);
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    // The values are moved in the instruction, VtArrays keep sharing their buffer with the layer until one side
+    // mutates it, so recording a large array does not copy it.
+    VtValue previousValue;
+    _layer->HasField(path, fieldName, &previousValue);
     VtValue newValue;
     value.GetValue(&newValue);
-    _undoCommands.StoreInstruction<UndoRedoSetField>({_layer, path, fieldName, newValue, previousValue});
+    JournalSetField(_layer, path, fieldName, newValue);
+    undoCommands->StoreInstruction<UndoRedoSetField>({_layer, path, fieldName, std::move(newValue), std::move(previousValue)});
 }
 
 void
@@ -115,9 +167,14 @@ UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
     const VtValue& value)
 {
     SetDirty();
-    const VtValue previousValue = _layer->GetFieldDictValueByKey(path, fieldName, keyPath); // TODO should the instruction retrieve the value instead ?
-    const VtValue newValue = value;
-    _undoCommands.StoreInstruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, newValue, previousValue});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalSetFieldDictValueByKey(_layer, path, fieldName, keyPath, value);
+    VtValue previousValue;
+    _layer->HasFieldDictKey(path, fieldName, keyPath, &previousValue);
+    undoCommands->StoreInstruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, value, std::move(previousValue)});
 }
 
 void
@@ -128,11 +185,17 @@ UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
     const SdfAbstractDataConstValue& value)
 {
     SetDirty();
-    const VtValue previousValue = _layer->GetFieldDictValueByKey(path, fieldName, keyPath);
-
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    VtValue previousValue;
+    _layer->HasFieldDictKey(path, fieldName, keyPath, &previousValue);
     VtValue newValue;
     value.GetValue(&newValue);
-    _undoCommands.StoreInstruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, newValue, previousValue});
+    JournalSetFieldDictValueByKey(_layer, path, fieldName, keyPath, newValue);
+    undoCommands->StoreInstruction<UndoRedoSetFieldDictValueByKey>(
+        {_layer, path, fieldName, keyPath, std::move(newValue), std::move(previousValue)});
 }
 
 void
@@ -142,7 +205,15 @@ UndoRedoLayerStateDelegate::_OnSetTimeSample(
     const VtValue& value)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoSetTimeSample>({_layer, path, timeCode, value});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalSetTimeSample(_layer, path, timeCode, value);
+    if (undoCommands->HasTimeSamplesRange(_layer, path)) {
+        return;
+    }
+    undoCommands->StoreInstruction<UndoRedoSetTimeSample>({_layer, path, timeCode, value});
 }
 
 void
@@ -152,10 +223,17 @@ UndoRedoLayerStateDelegate::_OnSetTimeSample(
     const SdfAbstractDataConstValue& value)
 {
     SetDirty();
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
     VtValue newValue;
     value.GetValue(&newValue);
-
-    _undoCommands.StoreInstruction<UndoRedoSetTimeSample>({_layer, path, timeCode, newValue});
+    JournalSetTimeSample(_layer, path, timeCode, newValue);
+    if (undoCommands->HasTimeSamplesRange(_layer, path)) {
+        return;
+    }
+    undoCommands->StoreInstruction<UndoRedoSetTimeSample>({_layer, path, timeCode, std::move(newValue)});
 }
 
 void
@@ -165,7 +243,12 @@ UndoRedoLayerStateDelegate::_OnCreateSpec(
     bool inert)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoCreateSpec>({_layer, path, specType, inert});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalCreateSpec(_layer, path, specType, inert);
+    undoCommands->StoreInstruction<UndoRedoCreateSpec>({_layer, path, specType, inert});
 }
 
 void
@@ -174,8 +257,12 @@ UndoRedoLayerStateDelegate::_OnDeleteSpec(
     bool inert)
 {
     SetDirty();
-
-    _undoCommands.StoreInstruction<UndoRedoDeleteSpec>({_layer, path,  inert, _GetLayerData()});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalDeleteSpec(_layer, path, inert);
+    undoCommands->StoreInstruction<UndoRedoDeleteSpec>({_layer, path,  inert, _GetLayerData()});
 
 }
 
@@ -185,7 +272,12 @@ UndoRedoLayerStateDelegate::_OnMoveSpec(
     const SdfPath& newPath)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoMoveSpec>({_layer, oldPath, newPath});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalMoveSpec(_layer, oldPath, newPath);
+    undoCommands->StoreInstruction<UndoRedoMoveSpec>({_layer, oldPath, newPath});
 }
 
 void
@@ -195,7 +287,12 @@ UndoRedoLayerStateDelegate::_OnPushChild(
     const TfToken& value)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPushChild<TfToken>>({_layer, parentPath, fieldName, value});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalPushChild(_layer, parentPath, fieldName, value);
+    undoCommands->StoreInstruction<UndoRedoPushChild<TfToken>>({_layer, parentPath, fieldName, value});
 }
 
 void
@@ -205,7 +302,12 @@ UndoRedoLayerStateDelegate::_OnPushChild(
     const SdfPath& value)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPushChild<SdfPath>>({_layer, parentPath, fieldName, value});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalPushChild(_layer, parentPath, fieldName, value);
+    undoCommands->StoreInstruction<UndoRedoPushChild<SdfPath>>({_layer, parentPath, fieldName, value});
 }
 
 void
@@ -215,7 +317,12 @@ UndoRedoLayerStateDelegate::_OnPopChild(
     const TfToken& oldValue)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPopChild<TfToken>>({_layer, parentPath, fieldName, oldValue});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalPopChild(_layer, parentPath, fieldName, oldValue);
+    undoCommands->StoreInstruction<UndoRedoPopChild<TfToken>>({_layer, parentPath, fieldName, oldValue});
 }
 
 void
@@ -225,7 +332,12 @@ UndoRedoLayerStateDelegate::_OnPopChild(
     const SdfPath& oldValue)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPopChild<SdfPath>>({_layer, parentPath, fieldName, oldValue});
+    SdfCommandGroup *undoCommands = GetRecordingCommandGroup();
+    if (!undoCommands) {
+        return;
+    }
+    JournalPopChild(_layer, parentPath, fieldName, oldValue);
+    undoCommands->StoreInstruction<UndoRedoPopChild<SdfPath>>({_layer, parentPath, fieldName, oldValue});
 }
 
 
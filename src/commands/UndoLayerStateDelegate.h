@@ -1,6 +1,7 @@
 #pragma once
 
 #include <pxr/usd/sdf/layerStateDelegate.h>
+#include <pxr/usd/usd/stage.h>
 
 
 PXR_NAMESPACE_USING_DIRECTIVE
@@ -9,19 +10,35 @@ TF_DECLARE_WEAK_AND_REF_PTRS(UndoRedoLayerStateDelegate);
 
 class SdfCommandGroup;
 
+///
+/// The undo/redo delegate is installed once on each layer and stays there. It records the edits in the current
+/// recording command group, shared by all the layers, and lets the edits pass through when there is none.
+///
+
+/// Command group recording the edits of all the layers, nullptr when not recording
+void SetRecordingCommandGroup(SdfCommandGroup *commandGroup);
+SdfCommandGroup *GetRecordingCommandGroup();
+
+/// Install the undo/redo delegate on the layer if it doesn't have one already
+void InstallUndoRedoDelegate(const SdfLayerHandle &layer);
+
+/// Install the undo/redo delegate on all the layers used by the stage. The layers loaded later by the stage,
+/// like new sublayers or payloads, receive the delegate when the stage notifies the change
+void InstallUndoRedoDelegates(const UsdStageRefPtr &stage);
+
 
 
 class UndoRedoLayerStateDelegate : public SdfLayerStateDelegateBase {
 public:
 
-    static UndoRedoLayerStateDelegateRefPtr New(SdfCommandGroup &undoCommands);
+    static UndoRedoLayerStateDelegateRefPtr New();
 
     void SetClean();
     void SetDirty();
 
 protected:
-    UndoRedoLayerStateDelegate(SdfCommandGroup &undoCommands)
-        : _dirty(false), _undoCommands(undoCommands)
+    UndoRedoLayerStateDelegate()
+        : _dirty(false)
     {
     }
 
@@ -100,7 +117,6 @@ protected:
 
 private:
     bool _dirty;
-    SdfCommandGroup &_undoCommands;
     SdfLayerHandle _layer;
 };
 
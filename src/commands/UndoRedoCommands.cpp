@@ -13,6 +13,7 @@ struct UndoCommand : public Command {
         if (undoStackPos > 0) {
             undoStackPos--;
             undoStack[undoStackPos]->UndoIt();
+            JournalUndo();
         }
 
         return false; // Should never be stored in the stack
@@ -33,6 +34,7 @@ struct RedoCommand : public Command {
         if (undoStackPos < undoStack.size()) {
             undoStack[undoStackPos]->DoIt();
             undoStackPos++;
+            JournalRedo();
         }
 
         return false; // Should never be stored in the stack
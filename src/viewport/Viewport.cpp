@@ -7,6 +7,7 @@
 #include <pxr/usd/usdGeom/metrics.h>
 #include <pxr/usd/usdGeom/bboxCache.h>
 #include <pxr/usd/usdGeom/imageable.h>
+#include <pxr/usdImaging/usdImaging/delegate.h>
 
 #include "Gui.h"
 #include "Viewport.h"
@@ -81,13 +82,10 @@ void DrawCameraList(Viewport &viewport) {
 }
 
 
-Viewport::Viewport(UsdStageRefPtr stage, Selection &selection)
-    : _stage(stage), _cameraManipulator({InitialWindowWidth, InitialWindowHeight}),
-      _currentEditingState(new MouseHoverManipulator()), _activeManipulator(&_positionManipulator), _selection(selection),
-      _viewportSize(InitialWindowWidth, InitialWindowHeight), _selectedCameraPath(perspectiveCameraPath), _renderCamera(&_perspectiveCamera) {
-
-    // Viewport draw target
-    _cameraManipulator.ResetPosition(GetCurrentCamera());
+Viewport::Viewport(UsdStageRefPtr stage)
+    : _cameraManipulator({InitialWindowWidth, InitialWindowHeight}),
+      _currentEditingState(new MouseHoverManipulator()), _activeManipulator(&_positionManipulator),
+      _viewportSize(InitialWindowWidth, InitialWindowHeight) {
 
     _drawTarget = GlfDrawTarget::New(_viewportSize, false);
     _drawTarget->Bind();
@@ -114,6 +112,8 @@ Viewport::Viewport(UsdStageRefPtr stage, Selection &selection)
     _renderparams->showProxy = true;
     _renderparams->showRender = false;
 
+    SetCurrentStage(stage);
+
     // Lights
     GlfSimpleLight simpleLight;
     simpleLight.SetAmbient({0.2, 0.2, 0.2, 1.0});
@@ -133,18 +133,18 @@ Viewport::Viewport(UsdStageRefPtr stage, Selection &selection)
 
 Viewport::~Viewport() {
     if (_renderer) {
-        _renderer = nullptr; // will be deleted in the map
+        _renderer = nullptr; // will be deleted with the stage states
     }
     // Delete renderers
     _drawTarget->Bind();
-    for (auto &renderer : _renderers) {
+    for (auto &stageState : _stageStates) {
         // Warning, InvalidateBuffers might be defered ... :S to check
         // removed in 20.11: renderer.second->InvalidateBuffers();
-        delete renderer.second;
-        renderer.second = nullptr;
+        delete stageState.second.renderer;
+        stageState.second.renderer = nullptr;
     }
     _drawTarget->Unbind();
-    _renderers.clear();
+    _stageStates.clear();
 
     if (_renderparams) {
         delete _renderparams;
@@ -395,11 +395,11 @@ const GfCamera &Viewport::GetCurrentCamera() const { return *_renderCamera; }
 UsdGeomCamera Viewport::GetUsdGeomCamera() { return UsdGeomCamera::Get(GetCurrentStage(), GetCameraPath()); }
 
 void Viewport::SetCameraPath(const SdfPath &cameraPath) {
-    _selectedCameraPath = cameraPath;
+    _stageState->selectedCameraPath = cameraPath;
 
-    _renderCamera = &_perspectiveCamera; // by default
+    _renderCamera = &_stageState->perspectiveCamera; // by default
     if (GetCurrentStage() && _renderparams) {
-        const auto selectedCameraPrim = UsdGeomCamera::Get(GetCurrentStage(), _selectedCameraPath);
+        const auto selectedCameraPrim = UsdGeomCamera::Get(GetCurrentStage(), cameraPath);
         if (selectedCameraPrim) {
             _renderCamera = &_stageCamera;
             _stageCamera = selectedCameraPrim.GetCamera(_renderparams->frame);
@@ -463,27 +463,62 @@ void Viewport::SetCurrentTimeCode(const UsdTimeCode &tc) {
     }
 }
 
+StageViewState &Viewport::GetStageState(UsdStageRefPtr stage) {
+    auto stageState = _stageStates.find(stage); /// We expect a very limited number of opened stages
+    if (stageState == _stageStates.end()) {
+        stageState = _stageStates.emplace(stage, StageViewState()).first;
+        stageState->second.selectedCameraPath = perspectiveCameraPath;
+        _cameraManipulator.ResetPosition(stageState->second.perspectiveCamera);
+    }
+    return stageState->second;
+}
+
+void Viewport::ReleaseStageStates(const UsdStageCache &stageCache) {
+    _drawTarget->Bind();
+    for (auto stageState = _stageStates.begin(); stageState != _stageStates.end();) {
+        const UsdStageWeakPtr &stage = stageState->first;
+        // The null stage state is kept, and the current one as it is pointed by _stageState
+        if (stage.IsInvalid() || (stage && &stageState->second != _stageState && !stageCache.Contains(stage))) {
+            delete stageState->second.renderer;
+            stageState = _stageStates.erase(stageState);
+        } else {
+            ++stageState;
+        }
+    }
+    _drawTarget->Unbind();
+}
+
+/// Switching stage swaps the state, the renderer, selection and cameras of the other stages are kept as they are
+void Viewport::SetCurrentStage(UsdStageRefPtr stage) {
+    if (_stageState && stage == _stage)
+        return;
+    if (_stageState) {
+        _stageState->frame = _renderparams->frame;
+    }
+    _stage = stage;
+    _stageState = &GetStageState(stage);
+    _renderer = _stageState->renderer;
+    _renderparams->frame = _stageState->frame;
+    SetCameraPath(_stageState->selectedCameraPath);
+    if (GetCurrentStage()) {
+        _cameraManipulator.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
+        _grid.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
+        // The manipulators point to prims of the previous stage
+        _positionManipulator.OnSelectionChange(*this);
+        _rotationManipulator.OnSelectionChange(*this);
+        _scaleManipulator.OnSelectionChange(*this);
+    }
+}
+
 /// Update anything that could have change after a frame render
 void Viewport::Update() {
     if (GetCurrentStage()) {
-        auto whichRenderer = _renderers.find(GetCurrentStage()); /// We expect a very limited number of opened stages
-        if (whichRenderer == _renderers.end()) {
+        if (!_stageState->renderer) {
             SdfPathVector excludedPaths;
             _renderer = new UsdImagingGLEngine(GetCurrentStage()->GetPseudoRoot().GetPath(), excludedPaths);
-            if (_renderers.empty()) {
-                FrameRootPrim();
-            }
-            _renderers[GetCurrentStage()] = _renderer;
-            _cameraManipulator.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
-            _grid.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
+            _stageState->renderer = _renderer;
+            FrameRootPrim();
             InitializeRendererAov(*_renderer);
-        } else if (whichRenderer->second != _renderer) {
-            _renderer = whichRenderer->second;
-            _cameraManipulator.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
-            // TODO: should reset the camera otherwise, depending on the position of the camera, the transform is incorrect
-            _grid.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
-            // TODO: the selection is also different per stage
-            //_selection =
         }
         // Camera -- TODO: is it slow to query the camera at each frame ?
         //                 the manipulator does is as well
@@ -504,14 +539,34 @@ void Viewport::Update() {
     GetCurrentCamera().SetPerspectiveFromAspectRatioAndFieldOfView(double(_viewportSize[0]) / double(_viewportSize[1]),
                                                                    _renderCamera->GetFieldOfView(GfCamera::FOVHorizontal),
                                                                    GfCamera::FOVHorizontal);
-    if (_renderer && UpdateSelectionHash(_selection, _lastSelectionHash)) {
-        _renderer->ClearSelected();
-        _renderer->SetSelected(GetSelectedPaths(_selection));
-
-        // Tell the manipulators the selection has changed
-        _positionManipulator.OnSelectionChange(*this);
-        _rotationManipulator.OnSelectionChange(*this);
-        _scaleManipulator.OnSelectionChange(*this);
+    const Selection &selection = _stageState->selection;
+    if (_renderer && GetSelectionGeneration(selection) != _stageState->lastSelectionGeneration) {
+        // Only the new paths are sent to the renderer. The engine can't unselect a path, so a removal
+        // needs the whole selection to be sent again
+        SdfPathVector added;
+        SdfPathVector removed;
+        const bool incremental =
+            GetSelectionChanges(selection, _stageState->lastSelectionGeneration, added, removed) && removed.empty();
+        if (UpdateSelectionHash(selection, _stageState->lastSelectionHash)) {
+            if (incremental) {
+                for (const auto &path : added) {
+                    _renderer->AddSelected(path, UsdImagingDelegate::ALL_INSTANCES);
+                }
+            } else {
+                _renderer->ClearSelected();
+                _renderer->SetSelected(GetSelectedPaths(selection));
+            }
+        }
+        _stageState->lastSelectionGeneration = GetSelectionGeneration(selection);
+
+        // Tell the manipulators the selection has changed, they only use the first selected path
+        const SdfPath selectedPath = GetSelectedPath(selection);
+        if (selectedPath != _stageState->lastSelectedPath) {
+            _stageState->lastSelectedPath = selectedPath;
+            _positionManipulator.OnSelectionChange(*this);
+            _rotationManipulator.OnSelectionChange(*this);
+            _scaleManipulator.OnSelectionChange(*this);
+        }
     }
 }
 
@@ -16,14 +16,31 @@
 #include "Grid.h"
 #include <pxr/imaging/glf/drawTarget.h>
 #include <pxr/usd/usd/stage.h>
+#include <pxr/usd/usd/stageCache.h>
 #include <pxr/usd/usdGeom/camera.h>
 #include <pxr/usdImaging/usdImagingGL/engine.h>
 #include <pxr/usdImaging/usdImagingGL/renderParams.h>
 #include <pxr/imaging/glf/simpleLight.h>
 
+/// State of the viewport kept for each stage, so switching between stages doesn't lose or recompute it
+struct StageViewState {
+    UsdImagingGLEngine *renderer = nullptr; // Created at the first update with the stage
+    Selection selection;
+
+    // Cameras
+    SdfPath selectedCameraPath;
+    GfCamera perspectiveCamera;
+    UsdTimeCode frame = 1.0;
+
+    // Selection already sent to the renderer
+    SelectionHash lastSelectionHash = 0;
+    uint64_t lastSelectionGeneration = 0;
+    SdfPath lastSelectedPath; // Path used by the manipulators
+};
+
 class Viewport final {
   public:
-    Viewport(UsdStageRefPtr stage, Selection &);
+    Viewport(UsdStageRefPtr stage);
     ~Viewport();
 
     // Delete copy
@@ -57,7 +74,7 @@ class Viewport final {
 
     // Set the camera path
     void SetCameraPath(const SdfPath &cameraPath);
-    const SdfPath &GetCameraPath() { return _selectedCameraPath; }
+    const SdfPath &GetCameraPath() { return _stageState->selectedCameraPath; }
     // Returns a UsdGeom camera if the selected camera is in the stage
     UsdGeomCamera GetUsdGeomCamera();
 
@@ -96,9 +113,14 @@ class Viewport final {
     UsdStageRefPtr GetCurrentStage() { return _stage; }
     const UsdStageRefPtr GetCurrentStage() const { return _stage; };
 
-    void SetCurrentStage(UsdStageRefPtr stage) { _stage = stage; }
+    /// Switch to the state of stage, it is created the first time the stage is seen
+    void SetCurrentStage(UsdStageRefPtr stage);
+
+    /// Delete the states of the stages released or not in the stage cache anymore. The renderer of a state
+    /// references its stage, so the stages are only freed once their state is deleted
+    void ReleaseStageStates(const UsdStageCache &stageCache);
 
-    Selection &GetSelection() { return _selection; }
+    Selection &GetSelection() { return _stageState->selection; }
 
     SelectionManipulator &GetSelectionManipulator() { return _selectionManipulator; }
 
@@ -108,6 +130,8 @@ class Viewport final {
     void HandleKeyboardShortcut();
 
   private:
+    StageViewState &GetStageState(UsdStageRefPtr stage);
+
     // GL Lights
     GlfSimpleLightVector _lights;
     GlfSimpleMaterial _material;
@@ -123,16 +147,13 @@ class Viewport final {
     ScaleManipulator _scaleManipulator;
     SelectionManipulator _selectionManipulator;
 
-    Selection &_selection;
-    SelectionHash _lastSelectionHash = 0;
+    /// States of the stages, a null stage has a state as well. std::map keeps the addresses of the states stable
+    std::map<UsdStageWeakPtr, StageViewState> _stageStates;
+    StageViewState *_stageState = nullptr; // State of the current stage
 
     /// Cameras
-    SdfPath _selectedCameraPath;
     GfCamera *_renderCamera; // Points to a valid camera, stage or perspective
     GfCamera _stageCamera;
-    // TODO: if we want to have multiple viewport, the persp camera shouldn't belong to the viewport but
-    // another shared object, CameraList or similar
-    GfCamera _perspectiveCamera; // opengl
 
     GfVec2i _viewportSize;
     GfVec2d _mousePosition;
@@ -142,8 +163,7 @@ class Viewport final {
 
     // Renderer
     GLuint _textureId = 0;
-    std::map<UsdStageRefPtr, UsdImagingGLEngine *> _renderers;
-    UsdImagingGLEngine *_renderer = nullptr;
+    UsdImagingGLEngine *_renderer = nullptr; // Renderer of the current stage
     UsdImagingGLRenderParams *_renderparams = nullptr;
     GlfDrawTargetRefPtr _drawTarget;
 };
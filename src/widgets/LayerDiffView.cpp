@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <vector>
+#include <pxr/base/tf/stringUtils.h>
+#include "LayerDiffView.h"
+#include "LayerDiff.h"
+#include "Gui.h"
+#include "Constants.h"
+
+/// Arrays with more elements are only described in the tooltips
+static constexpr size_t MaxDisplayedArraySize = 16;
+
+/// A spec row has a fieldIndex of -1, the field rows follow their spec row when it's unfolded
+struct LayerDiffRow {
+    size_t specIndex;
+    int fieldIndex;
+};
+
+struct LayerDiffViewState {
+    LayerDiff diff;
+    SdfLayerHandle layer;
+    SdfLayerHandle base; // Null for the file on disk
+    // Diff requested while the previous one was stopping, started once it has stopped
+    bool hasPendingDiff = false;
+    SdfLayerHandle pendingLayer;
+    SdfLayerHandle pendingBase;
+    std::vector<char> unfolded; // One per spec diff
+    std::vector<LayerDiffRow> rows;
+    bool rowsAreValid = false;
+    bool summaryIsValid = false;
+    size_t numAdded = 0;
+    size_t numRemoved = 0;
+    size_t numChanged = 0;
+};
+
+static LayerDiffViewState &GetLayerDiffViewState() {
+    static LayerDiffViewState state;
+    return state;
+}
+
+/// The selected layers are the compared ones only once their diff has started
+static void StartPendingLayerDiff(LayerDiffViewState &state) {
+    if (!state.hasPendingDiff || state.diff.IsRunning()) {
+        return;
+    }
+    state.hasPendingDiff = false;
+    if (state.diff.Start(state.pendingLayer, state.pendingBase)) {
+        state.layer = state.pendingLayer;
+        state.base = state.pendingBase;
+        state.rowsAreValid = false;
+        state.summaryIsValid = false;
+    }
+}
+
+/// The running diff is cancelled without waiting, the new one starts when it has stopped
+void StartLayerDiff(const SdfLayerHandle &layer, const SdfLayerHandle &base) {
+    LayerDiffViewState &state = GetLayerDiffViewState();
+    state.diff.Cancel();
+    state.hasPendingDiff = true;
+    state.pendingLayer = layer;
+    state.pendingBase = base;
+    StartPendingLayerDiff(state);
+}
+
+/// The rows are built once the diff is finished and when a spec is folded or unfolded
+static void UpdateLayerDiffRows(LayerDiffViewState &state) {
+    const auto &specDiffs = state.diff.GetSpecDiffs();
+    if (!state.summaryIsValid) {
+        state.unfolded.assign(specDiffs.size(), false);
+        state.numAdded = state.numRemoved = state.numChanged = 0;
+        for (const auto &specDiff : specDiffs) {
+            switch (specDiff.change) {
+            case LayerDiff::Change::Added:
+                state.numAdded++;
+                break;
+            case LayerDiff::Change::Removed:
+                state.numRemoved++;
+                break;
+            case LayerDiff::Change::Changed:
+                state.numChanged++;
+                break;
+            }
+        }
+        state.summaryIsValid = true;
+    }
+    state.rows.clear();
+    for (size_t specIndex = 0; specIndex < specDiffs.size(); ++specIndex) {
+        state.rows.push_back({specIndex, -1});
+        if (state.unfolded[specIndex]) {
+            for (size_t fieldIndex = 0; fieldIndex < specDiffs[specIndex].fields.size(); ++fieldIndex) {
+                state.rows.push_back({specIndex, static_cast<int>(fieldIndex)});
+            }
+        }
+    }
+    state.rowsAreValid = true;
+}
+
+static ImVec4 GetChangeColor(LayerDiff::Change change) {
+    switch (change) {
+    case LayerDiff::Change::Added:
+        return ImVec4(0.4, 0.9, 0.4, 1.0);
+    case LayerDiff::Change::Removed:
+        return ImVec4(1.0, 0.4, 0.4, 1.0);
+    default:
+        return ImVec4(1.0, 0.7, 0.3, 1.0);
+    }
+}
+
+static const char *GetChangeName(LayerDiff::Change change) {
+    switch (change) {
+    case LayerDiff::Change::Added:
+        return "Added";
+    case LayerDiff::Change::Removed:
+        return "Removed";
+    default:
+        return "Changed";
+    }
+}
+
+/// Short description of a field value, the big arrays are not printed
+static std::string GetFieldValueText(const SdfLayerRefPtr &layer, const SdfPath &path, const TfToken &field) {
+    if (!layer || !layer->HasField(path, field)) {
+        return "<none>";
+    }
+    const VtValue value = layer->GetField(path, field);
+    if (value.IsArrayValued() && value.GetArraySize() > MaxDisplayedArraySize) {
+        return value.GetTypeName() + " with " + std::to_string(value.GetArraySize()) + " elements";
+    }
+    return TfStringify(value);
+}
+
+static void DrawLayerSelectionCombo(const char *label, SdfLayerHandle &layer, const char *noLayerName) {
+    if (ImGui::BeginCombo(label, layer ? layer->GetDisplayName().c_str() : noLayerName)) {
+        if (noLayerName && ImGui::Selectable(noLayerName, !layer)) {
+            layer = SdfLayerHandle();
+        }
+        std::vector<SdfLayerHandle> layers;
+        for (const auto &loadedLayer : SdfLayer::GetLoadedLayers()) {
+            layers.push_back(loadedLayer);
+        }
+        std::sort(layers.begin(), layers.end(),
+                  [](const SdfLayerHandle &a, const SdfLayerHandle &b) { return a->GetDisplayName() < b->GetDisplayName(); });
+        for (const auto &loadedLayer : layers) {
+            ImGui::PushID(loadedLayer->GetUniqueIdentifier());
+            if (ImGui::Selectable(loadedLayer->GetDisplayName().c_str(), layer == loadedLayer)) {
+                layer = loadedLayer;
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndCombo();
+    }
+}
+
+static void DrawLayerDiffProgress(LayerDiffViewState &state) {
+    LayerDiff &diff = state.diff;
+    if (ImGui::SmallButton(ICON_FA_TIMES)) {
+        diff.Cancel();
+        state.hasPendingDiff = false;
+    }
+    ImGui::SameLine();
+    switch (diff.GetPhase()) {
+    case LayerDiff::Phase::Reading:
+        ImGui::ProgressBar(0.f, ImVec2(-1, 0), "Reading the file");
+        break;
+    case LayerDiff::Phase::Listing:
+        ImGui::ProgressBar(0.f, ImVec2(-1, 0), "Listing the specs");
+        break;
+    default: {
+        const size_t numSpecs = diff.GetNumSpecsToCompare();
+        const size_t numCompared = diff.GetNumComparedSpecs();
+        const std::string overlay = std::to_string(numCompared) + "/" + std::to_string(numSpecs) + " specs";
+        ImGui::ProgressBar(numSpecs ? static_cast<float>(numCompared) / numSpecs : 1.f, ImVec2(-1, 0), overlay.c_str());
+    }
+    }
+}
+
+static void DrawLayerDiffRow(const LayerDiffRow &row, LayerDiffViewState &state) {
+    const LayerDiff::SpecDiff &specDiff = state.diff.GetSpecDiffs()[row.specIndex];
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    if (row.fieldIndex < 0) {
+        ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+        if (specDiff.fields.empty()) {
+            flags |= ImGuiTreeNodeFlags_Leaf;
+        }
+        const bool unfolded = state.unfolded[row.specIndex];
+        ImGui::SetNextItemOpen(unfolded);
+        ImGui::PushStyleColor(ImGuiCol_Text, GetChangeColor(specDiff.change));
+        ImGui::TreeNodeEx(reinterpret_cast<void *>(row.specIndex), flags, "%s", specDiff.path.GetText());
+        ImGui::PopStyleColor();
+        if (ImGui::IsItemToggledOpen()) {
+            state.unfolded[row.specIndex] = !unfolded;
+            state.rowsAreValid = false;
+        }
+        ImGui::TableSetColumnIndex(1);
+        ImGui::TextColored(GetChangeColor(specDiff.change), "%s", GetChangeName(specDiff.change));
+    } else {
+        const LayerDiff::FieldDiff &fieldDiff = specDiff.fields[row.fieldIndex];
+        ImGui::Indent();
+        ImGui::TextColored(GetChangeColor(fieldDiff.change), "%s", fieldDiff.field.GetText());
+        ImGui::Unindent();
+        // The values are only read for the hovered field
+        if (ImGui::IsItemHovered()) {
+            ImGui::BeginTooltip();
+            ImGui::PushTextWrapPos(ImGui::GetFontSize() * 40);
+            ImGui::Text("Before: %s", GetFieldValueText(state.diff.GetBaseLayer(), specDiff.path, fieldDiff.field).c_str());
+            ImGui::Text("After: %s", GetFieldValueText(state.diff.GetLayer(), specDiff.path, fieldDiff.field).c_str());
+            ImGui::PopTextWrapPos();
+            ImGui::EndTooltip();
+        }
+        ImGui::TableSetColumnIndex(1);
+        ImGui::TextColored(GetChangeColor(fieldDiff.change), "%s", GetChangeName(fieldDiff.change));
+    }
+}
+
+void DrawLayerDiffView(const SdfLayerHandle &currentLayer) {
+    LayerDiffViewState &state = GetLayerDiffViewState();
+    StartPendingLayerDiff(state);
+    if (!state.layer) {
+        state.layer = currentLayer;
+    }
+    DrawLayerSelectionCombo("Layer", state.layer, nullptr);
+    DrawLayerSelectionCombo("Changed from", state.base, "File on disk");
+
+    LayerDiff &diff = state.diff;
+    if (diff.IsRunning() || state.hasPendingDiff) {
+        DrawLayerDiffProgress(state);
+        return;
+    }
+    if (ImGui::Button("Compare") && state.layer) {
+        StartLayerDiff(state.layer, state.base);
+        return;
+    }
+    if (diff.GetPhase() != LayerDiff::Phase::Finished) {
+        return;
+    }
+    if (!diff.GetError().empty()) {
+        ImGui::TextColored(ImVec4(1.0, 0.3, 0.3, 1.0), "%s", diff.GetError().c_str());
+        return;
+    }
+    if (diff.IsOutdated()) {
+        ImGui::Text("The layers were edited during the comparison, compare them again.");
+        return;
+    }
+    if (!state.rowsAreValid) {
+        UpdateLayerDiffRows(state);
+    }
+    ImGui::SameLine();
+    ImGui::Text("%zu added, %zu removed and %zu changed specs", state.numAdded, state.numRemoved, state.numChanged);
+
+    constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("##LayerDiff", 2, tableFlags)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Spec", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Change", ImGuiTableColumnFlags_WidthFixed, ImGui::GetFontSize() * 6);
+        ImGui::TableHeadersRow();
+        // Only the visible rows are drawn
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(state.rows.size()));
+        while (clipper.Step()) {
+            for (int rowIndex = clipper.DisplayStart; rowIndex < clipper.DisplayEnd; ++rowIndex) {
+                DrawLayerDiffRow(state.rows[rowIndex], state);
+            }
+        }
+        ImGui::EndTable();
+    }
+}
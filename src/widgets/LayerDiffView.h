@@ -0,0 +1,12 @@
+#pragma once
+#include <pxr/usd/sdf/layer.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// Draw the choice of the compared layers, the progress of the diff and its result as a tree of the changed specs
+/// and fields. Only the visible rows are drawn
+void DrawLayerDiffView(const SdfLayerHandle &currentLayer);
+
+/// Start looking for the changes from base to layer. A null base compares the layer with its file on disk. A running
+/// diff is cancelled, the new one starts once it has stopped
+void StartLayerDiff(const SdfLayerHandle &layer, const SdfLayerHandle &base = SdfLayerHandle());
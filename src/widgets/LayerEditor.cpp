@@ -1,13 +1,16 @@
+#include <algorithm>
 #include <iostream>
-#include <iomanip>
-#include <sstream>
+#include <iterator>
 #include <array>
-#include <cctype>
+#include <map>
+#include <memory>
 
 #include <pxr/usd/usd/schemaRegistry.h>
 #include <pxr/usd/usd/prim.h>
 #include <pxr/usd/sdf/layer.h>
 #include <pxr/usd/sdf/layerUtils.h>
+#include <pxr/usd/sdf/notice.h>
+#include <pxr/usd/sdf/pathTable.h>
 #include <pxr/usd/sdf/fileFormat.h>
 #include <pxr/usd/sdf/primSpec.h>
 #include <pxr/usd/sdf/types.h>
@@ -18,6 +21,8 @@
 #include <pxr/usd/usdGeom/camera.h>
 
 #include "Editor.h"
+#include "SublayerCache.h"
+#include "PrimNames.h"
 #include "Commands.h"
 #include "ModalDialogs.h"
 #include "FileBrowser.h"
@@ -108,40 +113,54 @@ struct AddVariantModalDialog : public ModalDialog {
     bool _addToEditList = false;
 };
 
-// Look for a new name. If prefix ends with a number, it will increase its value until
-// a valid name/token is found
-static std::string FindNextAvailablePrimName(std::string prefix) {
-    // Find number in the prefix
-    size_t end = prefix.size() - 1;
-    while (end > 0 && std::isdigit(prefix[end])) {
-        end--;
-    }
-    size_t padding = prefix.size() - 1 - end;
-    const std::string number = prefix.substr(end + 1, padding);
-    auto value = number.size() ? std::stoi(number) : 0;
-    std::ostringstream newName;
-    padding = padding == 0 ? 4 : padding; // 4: default padding
-    do {
-        value += 1;
-        newName.seekp(0, std::ios_base::beg); // rewind
-        newName << prefix.substr(0, end + 1) << std::setfill('0') << std::setw(padding) << value;
-        // Looking for existing token with the same name.
-        // There might be a better solution here
-    } while (TfToken::Find(newName.str()) != TfToken());
-    return newName.str();
-}
+/// Create many children at once, their names are reserved in bulk in the name index of the parent
+struct AddChildrenModalDialog : public ModalDialog {
+
+    AddChildrenModalDialog(SdfPrimSpecHandle &primSpec) : _primSpec(primSpec){};
+
+    ~AddChildrenModalDialog() override {}
+
+    void Draw() override {
+        if (!_primSpec) {
+            CloseModal();
+            return;
+        }
+        ImGui::InputText("Name prefix", &_prefix);
+        ImGui::InputInt("Number of children", &_count);
+        _count = std::max(_count, 1);
+        if (ImGui::Button("Add")) {
+            ExecuteAfterDraw<PrimNew>(_primSpec, FindNextAvailablePrimNames(_primSpec->GetLayer(), _primSpec->GetPath(),
+                                                                            _prefix, static_cast<size_t>(_count)));
+            CloseModal();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) {
+            CloseModal();
+        }
+    }
+
+    const char *DialogId() const override { return "Add children"; }
+    SdfPrimSpecHandle _primSpec;
+    std::string _prefix = DefaultPrimSpecName;
+    int _count = 10;
+};
 
 void DrawTreeNodePopup(SdfPrimSpecHandle &primSpec) {
     if (!primSpec)
         return;
 
     if (ImGui::MenuItem("Add child")) {
-        ExecuteAfterDraw<PrimNew>(primSpec, FindNextAvailablePrimName(DefaultPrimSpecName));
+        const std::string primName = FindNextAvailablePrimName(primSpec->GetLayer(), primSpec->GetPath(), DefaultPrimSpecName);
+        ExecuteAfterDraw<PrimNew>(primSpec, primName);
+    }
+    if (ImGui::MenuItem("Add children...")) {
+        DrawModalDialog<AddChildrenModalDialog>(primSpec);
     }
     auto parent = primSpec->GetNameParent();
     if (parent) {
         if (ImGui::MenuItem("Add sibling")) {
-            ExecuteAfterDraw<PrimNew>(parent, FindNextAvailablePrimName(primSpec->GetName()));
+            const std::string primName = FindNextAvailablePrimName(parent->GetLayer(), parent->GetPath(), primSpec->GetName());
+            ExecuteAfterDraw<PrimNew>(parent, primName);
         }
     }
 
@@ -217,9 +236,142 @@ static void HandleDragAndDrop(SdfPrimSpecHandle &primSpec) {
     }
 }
 
-// Returns unfolded
+///
+/// The prim hierarchy of a layer is drawn from rows flattened in depth first order. Only the rows of the unfolded specs
+/// are built, from the children fields of the layer, and only the visible rows are drawn and read their spec.
+/// The rows are rebuilt when the hierarchy of the layer changes.
+///
+struct LayerHierarchyRow {
+    SdfPath path; // Prim spec or variant path
+    int depth = 0;
+    bool hasChildren = false;
+};
+
+/// Paths of the children drawn under a spec: the variants first, then the prim children
+static void GetLayerHierarchyChildren(const SdfLayerHandle &layer, const SdfPath &path, SdfPathVector &children) {
+    if (!path.IsAbsoluteRootPath()) {
+        for (const auto &variantSet : layer->GetFieldAs<TfTokenVector>(path, SdfChildrenKeys->VariantSetChildren)) {
+            const SdfPath variantSetPath = path.AppendVariantSelection(variantSet, "");
+            for (const auto &variant : layer->GetFieldAs<TfTokenVector>(variantSetPath, SdfChildrenKeys->VariantChildren)) {
+                children.push_back(path.AppendVariantSelection(variantSet, variant));
+            }
+        }
+    }
+    for (const auto &name : layer->GetFieldAs<TfTokenVector>(path, SdfChildrenKeys->PrimChildren)) {
+        children.push_back(path.AppendChild(name));
+    }
+}
+
+static bool HasLayerHierarchyChildren(const SdfLayerHandle &layer, const SdfPath &path) {
+    return !layer->GetFieldAs<TfTokenVector>(path, SdfChildrenKeys->PrimChildren).empty() ||
+           (!path.IsAbsoluteRootPath() &&
+            !layer->GetFieldAs<TfTokenVector>(path, SdfChildrenKeys->VariantSetChildren).empty());
+}
+
+class LayerHierarchyState : public TfWeakBase {
+  public:
+    LayerHierarchyState(const SdfLayerHandle &layer) : _layer(layer) {
+        _noticeKey = TfNotice::Register(TfCreateWeakPtr(this), &LayerHierarchyState::OnLayersDidChange);
+        _unfoldedPaths[SdfPath::AbsoluteRootPath()] = true;
+    }
+    ~LayerHierarchyState() { TfNotice::Revoke(_noticeKey); }
+
+    void OnLayersDidChange(const SdfNotice::LayersDidChange &notice) {
+        if (!_rowsAreValid) {
+            return;
+        }
+        for (const auto &layerChanges : notice.GetChangeListVec()) {
+            if (layerChanges.first != _layer) {
+                continue;
+            }
+            // Only the changes of the hierarchy, the visible rows read their specs every frame
+            for (const auto &entry : layerChanges.second.GetEntryList()) {
+                const auto &flags = entry.second.flags;
+                if (flags.didAddInertPrim || flags.didAddNonInertPrim || flags.didRemoveInertPrim ||
+                    flags.didRemoveNonInertPrim || flags.didReorderChildren || flags.didRename ||
+                    flags.didChangePrimVariantSets || flags.didReplaceContent || flags.didReloadContent) {
+                    _rowsAreValid = false;
+                    return;
+                }
+            }
+        }
+    }
+
+    bool IsUnfolded(const SdfPath &path) const {
+        const auto it = _unfoldedPaths.find(path);
+        return it != _unfoldedPaths.end() && it->second;
+    }
+
+    void SetUnfolded(const SdfPath &path, bool unfolded) {
+        if (IsUnfolded(path) != unfolded) {
+            _unfoldedPaths[path] = unfolded;
+            _rowsAreValid = false;
+        }
+    }
+
+    /// Rows of the specs under the layer row
+    const std::vector<LayerHierarchyRow> &GetRows() {
+        if (!_rowsAreValid) {
+            _rows.clear();
+            if (_layer && IsUnfolded(SdfPath::AbsoluteRootPath())) {
+                AppendChildRows(SdfPath::AbsoluteRootPath(), 0);
+            }
+            _rowsAreValid = true;
+        }
+        return _rows;
+    }
+
+  private:
+    /// Append the rows of the children of path and of their unfolded descendants, with an explicit stack
+    void AppendChildRows(const SdfPath &path, int depth) {
+        std::vector<LayerHierarchyRow> pendingRows;
+        SdfPathVector children;
+        const auto pushChildren = [&](const SdfPath &parentPath, int childDepth) {
+            children.clear();
+            GetLayerHierarchyChildren(_layer, parentPath, children);
+            // The children are pushed in reverse order to be popped in order
+            for (auto child = children.rbegin(); child != children.rend(); ++child) {
+                LayerHierarchyRow row;
+                row.path = *child;
+                row.depth = childDepth;
+                pendingRows.push_back(row);
+            }
+        };
+        pushChildren(path, depth);
+        while (!pendingRows.empty()) {
+            LayerHierarchyRow row = std::move(pendingRows.back());
+            pendingRows.pop_back();
+            row.hasChildren = HasLayerHierarchyChildren(_layer, row.path);
+            _rows.push_back(row);
+            if (row.hasChildren && IsUnfolded(row.path)) {
+                pushChildren(row.path, row.depth + 1);
+            }
+        }
+    }
+
+    SdfLayerHandle _layer;
+    TfNotice::Key _noticeKey;
+    SdfPathTable<bool> _unfoldedPaths;
+    std::vector<LayerHierarchyRow> _rows;
+    bool _rowsAreValid = false;
+};
+
+static LayerHierarchyState &GetLayerHierarchyState(const SdfLayerHandle &layer) {
+    static std::map<SdfLayerHandle, std::unique_ptr<LayerHierarchyState>> hierarchyStates;
+    // The states of the released layers are deleted with their notice listener
+    for (auto hierarchyState = hierarchyStates.begin(); hierarchyState != hierarchyStates.end();) {
+        hierarchyState = hierarchyState->first.IsInvalid() ? hierarchyStates.erase(hierarchyState) : std::next(hierarchyState);
+    }
+    auto &state = hierarchyStates[layer];
+    if (!state) {
+        state.reset(new LayerHierarchyState(layer));
+    }
+    return *state;
+}
+
+// Returns true when the node was toggled
 static bool DrawTreeNodePrimName(const bool &primIsVariant, SdfPrimSpecHandle &primSpec, SdfPrimSpecHandle &selectedPrim,
-                                 bool hasChildren) {
+                                 bool hasChildren, bool unfolded) {
     // Format text differently when the prim is a variant
     std::string primSpecName;
     if (primIsVariant) {
@@ -231,14 +383,19 @@ static bool DrawTreeNodePrimName(const bool &primIsVariant, SdfPrimSpecHandle &p
     ScopedStyleColor textColor(ImGuiCol_Text,
                                primIsVariant ? ImU32(ImColor::HSV(0.2 / 7.0f, 0.5f, 0.8f)) : ImGui::GetColorU32(ImGuiCol_Text));
 
-    ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap;
-     nodeFlags |= hasChildren && !primSpec->HasVariantSetNames() ? ImGuiTreeNodeFlags_Leaf : ImGuiTreeNodeFlags_DefaultOpen;
+    ImGuiTreeNodeFlags nodeFlags =
+        ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+    if (!hasChildren) {
+        nodeFlags |= ImGuiTreeNodeFlags_Leaf;
+    }
     auto cursor = ImGui::GetCursorPos(); // Store position for the InputText to edit the prim name
-    auto unfolded = ImGui::TreeNodeEx(primSpecName.c_str(), nodeFlags);
+    ImGui::SetNextItemOpen(unfolded);
+    ImGui::TreeNodeEx(primSpecName.c_str(), nodeFlags);
+    const bool toggled = ImGui::IsItemToggledOpen();
 
     // Edition of the prim name
     static SdfPrimSpecHandle editNamePrim;
-    if (ImGui::IsItemClicked()) {
+    if (ImGui::IsItemClicked() && !toggled) {
         selectedPrim = primSpec;
         if (editNamePrim != SdfPrimSpecHandle() && editNamePrim != selectedPrim) {
             editNamePrim = SdfPrimSpecHandle();
@@ -256,22 +413,22 @@ static bool DrawTreeNodePrimName(const bool &primIsVariant, SdfPrimSpecHandle &p
         }
         ImGui::PopStyleColor();
     }
-    return unfolded;
+    return toggled;
 }
 
-/// Draw a node in the primspec tree
-static void DrawPrimSpecRow(SdfPrimSpecHandle primSpec, SdfPrimSpecHandle &selectedPrim, int nodeId) {
-
+/// Draw a row of the primspec tree, the depth is drawn with an indentation
+static void DrawPrimSpecRow(const LayerHierarchyRow &row, const SdfLayerHandle &layer, LayerHierarchyState &state,
+                            SdfPrimSpecHandle &selectedPrim) {
+    SdfPrimSpecHandle primSpec = layer->GetPrimAtPath(row.path);
     if (!primSpec)
         return;
-    bool primIsVariant = primSpec->GetPath().IsPrimVariantSelectionPath();
+    bool primIsVariant = row.path.IsPrimVariantSelectionPath();
 
     ImGui::TableNextRow();
 
     ImGui::TableSetColumnIndex(0);
 
-    ImGui::PushID(nodeId);
-    nodeId = 0; // reset the counter
+    ImGui::PushID(reinterpret_cast<void *>(SdfPath::Hash{}(row.path)));
 
     DrawBackgroundSelection(primSpec, selectedPrim);
 
@@ -279,16 +436,20 @@ static void DrawPrimSpecRow(SdfPrimSpecHandle primSpec, SdfPrimSpecHandle &selec
     HandleDragAndDrop(primSpec);
 
     // Draw the tree column
-    auto childrenNames = primSpec->GetNameChildren();
-
     ImGui::SameLine();
-    bool unfolded = DrawTreeNodePrimName(primIsVariant, primSpec, selectedPrim, childrenNames.empty());
+    const float indent = (row.depth + 1) * ImGui::GetStyle().IndentSpacing;
+    ImGui::Indent(indent);
+    const bool unfolded = state.IsUnfolded(row.path);
+    if (DrawTreeNodePrimName(primIsVariant, primSpec, selectedPrim, row.hasChildren, unfolded)) {
+        state.SetUnfolded(row.path, !unfolded);
+    }
 
     // Right click will open the quick edit popup menu
     if (ImGui::BeginPopupContextItem()) {
         DrawTreeNodePopup(primSpec);
         ImGui::EndPopup();
     }
+    ImGui::Unindent(indent);
 
     // We want transparent combos
     ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(0.0, 0.0, 0.0, 0.0));
@@ -309,24 +470,6 @@ static void DrawPrimSpecRow(SdfPrimSpecHandle primSpec, SdfPrimSpecHandle &selec
     ImGui::TableSetColumnIndex(3);
     DrawPrimCompositionSummary(primSpec);
 
-    // Draw children
-    if (unfolded) {
-        SdfVariantSetsProxy variantSetMap = primSpec->GetVariantSets();
-        TF_FOR_ALL(varSetIt, variantSetMap) {
-            const SdfVariantSetSpecHandle &varSetSpec = varSetIt->second;
-            const SdfVariantSpecHandleVector &variants = varSetSpec->GetVariantList();
-            TF_FOR_ALL(varIt, variants) {
-                const SdfPrimSpecHandle &variantSpec = (*varIt)->GetPrimSpec();
-                DrawPrimSpecRow(variantSpec, selectedPrim, nodeId++);
-            }
-        }
-
-        for (int i = 0; i < childrenNames.size(); ++i) {
-            DrawPrimSpecRow(childrenNames[i], selectedPrim, nodeId++);
-        }
-        ImGui::TreePop();
-    }
-
     ImGui::PopID();
 }
 
@@ -334,6 +477,7 @@ void DrawLayerPrimHierarchy(SdfLayerRefPtr layer, SdfPrimSpecHandle &selectedPri
 
     if (!layer) return;
 
+    LayerHierarchyState &state = GetLayerHierarchyState(layer);
     constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
     if (ImGui::BeginTable("##DrawPrimSpecTree", 4, tableFlags, size)) {
         ImGui::TableSetupColumn("Hierarchy");
@@ -343,9 +487,9 @@ void DrawLayerPrimHierarchy(SdfLayerRefPtr layer, SdfPrimSpecHandle &selectedPri
         ImGui::TableSetupScrollFreeze(4, 1);
         ImGui::TableHeadersRow();
 
-        ImGuiTreeNodeFlags treeNodeFlags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap;
-        int nodeId = 0;
-        if (layer->GetRootPrims().empty()) {
+        ImGuiTreeNodeFlags treeNodeFlags =
+            ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+        if (!HasLayerHierarchyChildren(layer, SdfPath::AbsoluteRootPath())) {
             treeNodeFlags |= ImGuiTreeNodeFlags_Leaf;
         }
         ImGui::TableNextRow();
@@ -354,23 +498,32 @@ void DrawLayerPrimHierarchy(SdfLayerRefPtr layer, SdfPrimSpecHandle &selectedPri
         DrawBackgroundSelection(SdfPrimSpecHandle(), selectedPrim);
 
         std::string label = std::string(ICON_FA_FILE) + " " + layer->GetDisplayName();
-        bool unfolded = ImGui::TreeNodeEx(label.c_str(), treeNodeFlags );
+        const bool unfolded = state.IsUnfolded(SdfPath::AbsoluteRootPath());
+        ImGui::SetNextItemOpen(unfolded);
+        ImGui::TreeNodeEx(label.c_str(), treeNodeFlags);
 
-        if (ImGui::IsItemClicked()) {
+        if (ImGui::IsItemToggledOpen()) {
+            state.SetUnfolded(SdfPath::AbsoluteRootPath(), !unfolded);
+        } else if (ImGui::IsItemClicked()) {
             selectedPrim = SdfPrimSpecHandle();
         }
 
         if (ImGui::BeginPopupContextItem()) {
             if (ImGui::MenuItem("Add root prim")) {
-                ExecuteAfterDraw<PrimNew>(layer, FindNextAvailablePrimName(DefaultPrimSpecName));
+                const std::string primName = FindNextAvailablePrimName(layer, SdfPath::AbsoluteRootPath(), DefaultPrimSpecName);
+                ExecuteAfterDraw<PrimNew>(layer, primName);
             }
             ImGui::EndPopup();
         }
-        if (unfolded) {
-            for (const auto &child : layer->GetRootPrims()) {
-                DrawPrimSpecRow(child, selectedPrim, nodeId++);
+
+        // Only the visible rows are drawn
+        const std::vector<LayerHierarchyRow> &rows = state.GetRows();
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(rows.size()));
+        while (clipper.Step()) {
+            for (int rowIndex = clipper.DisplayStart; rowIndex < clipper.DisplayEnd; ++rowIndex) {
+                DrawPrimSpecRow(rows[rowIndex], layer, state, selectedPrim);
             }
-            ImGui::TreePop();
         }
         ImGui::EndTable();
     }
@@ -463,19 +616,39 @@ void DrawLayerHeader(SdfLayerRefPtr layer) {
     }
 }
 
-static void DrawLayerSublayerTree(SdfLayerRefPtr layer, SdfLayerRefPtr parent, std::string layerPath, int nodeID=0) {
+/// The sublayers are opened in the background, the tree is drawn from the cache
+static SublayerCache &GetSublayerCache() {
+    static SublayerCache sublayerCache;
+    return sublayerCache;
+}
+
+/// ancestors are the layers of the branch above the layer, a sublayer found in them is a cycle and isn't followed
+static void DrawLayerSublayerTree(SdfLayerRefPtr layer, SdfLayerRefPtr parent, std::string layerPath,
+                                  SublayerCache::Status status, std::vector<SdfLayerHandle> &ancestors, int nodeID = 0) {
     // Note: layer can be null if it wasn't found
     ImGui::TableNextRow();
     ImGui::TableSetColumnIndex(0);
+    const bool isCycle = layer && std::find(ancestors.begin(), ancestors.end(), layer) != ancestors.end();
     ImGuiTreeNodeFlags treeNodeFlags = ImGuiTreeNodeFlags_OpenOnArrow;
-    if (!layer || !layer->GetNumSubLayerPaths()) {
+    if (!layer || isCycle || !layer->GetNumSubLayerPaths()) {
         treeNodeFlags |= ImGuiTreeNodeFlags_Leaf;
     }
     ImGui::PushID(nodeID);
-    std::string label =
-        layer ? (layer->IsMuted() ? ICON_FA_EYE_SLASH " " : ICON_FA_EYE " ") + layer->GetDisplayName() : "Not found " + layerPath;
+    std::string label;
+    if (status == SublayerCache::Status::Pending) {
+        label = "Opening " + layerPath;
+    } else if (!layer) {
+        label = "Not found " + layerPath;
+    } else if (isCycle) {
+        label = "Cycle " + layer->GetDisplayName();
+    } else {
+        label = (layer->IsMuted() ? ICON_FA_EYE_SLASH " " : ICON_FA_EYE " ") + layer->GetDisplayName();
+    }
     bool unfolded = ImGui::TreeNodeEx(label.c_str(), treeNodeFlags);
     if (ImGui::BeginPopupContextItem()) {
+        if (status == SublayerCache::Status::Missing && parent && ImGui::MenuItem("Retry")) {
+            GetSublayerCache().Retry(parent, layerPath);
+        }
         if (layer && ImGui::MenuItem("Add sublayer")) {
             DrawModalDialog<AddSublayer>(layer);
         }
@@ -504,12 +677,15 @@ static void DrawLayerSublayerTree(SdfLayerRefPtr layer, SdfLayerRefPtr parent, s
     }
 
     if (unfolded) {
-        if (layer) {
+        if (layer && !isCycle) {
+            ancestors.push_back(layer);
             std::vector<std::string> subLayers = layer->GetSubLayerPaths();
             for (auto subLayerPath : subLayers) {
-                auto subLayer = SdfLayer::FindOrOpenRelativeToLayer(layer, subLayerPath);
-                DrawLayerSublayerTree(subLayer, layer, subLayerPath, nodeID++);
+                SdfLayerRefPtr subLayer;
+                const SublayerCache::Status subLayerStatus = GetSublayerCache().Get(layer, subLayerPath, subLayer);
+                DrawLayerSublayerTree(subLayer, layer, subLayerPath, subLayerStatus, ancestors, nodeID++);
             }
+            ancestors.pop_back();
         }
         ImGui::TreePop();
     }
@@ -523,7 +699,10 @@ void DrawLayerSublayers(SdfLayerRefPtr layer, ImVec2 &size) {
     if (ImGui::BeginTable("##DrawLayerSublayers", 1, tableFlags, size)) {
         ImGui::TableSetupColumn("Layers");
         ImGui::TableHeadersRow();
-        DrawLayerSublayerTree(layer, SdfLayerRefPtr(), std::string());
+        // The entries of the closed layers are erased once per frame, not on each lookup
+        GetSublayerCache().Prune();
+        std::vector<SdfLayerHandle> ancestors;
+        DrawLayerSublayerTree(layer, SdfLayerRefPtr(), std::string(), SublayerCache::Status::Found, ancestors);
         ImGui::EndTable();
     }
 }
@@ -543,7 +722,7 @@ static void DrawLayerNavigation(SdfLayerRefPtr layer, SdfPrimSpecHandle &selecte
     if (!layer)
         return;
     if (ImGui::Button("Add root prim")) {
-        ExecuteAfterDraw<PrimNew>(layer, FindNextAvailablePrimName(DefaultPrimSpecName));
+        ExecuteAfterDraw<PrimNew>(layer, FindNextAvailablePrimName(layer, SdfPath::AbsoluteRootPath(), DefaultPrimSpecName));
     }
     ImGui::SameLine();
     if (ImGui::Button("Add sublayer")) {
@@ -592,6 +771,9 @@ void DrawLayerActionPopupMenu(SdfLayerHandle layer) {
     if (ImGui::MenuItem("Open as Stage")) {
         ExecuteAfterDraw<EditorOpenStage>(layer->GetRealPath());
     }
+    if (!layer->GetRealPath().empty() && ImGui::MenuItem("Show unsaved changes")) {
+        ExecuteAfterDraw<EditorShowLayerDiff>(layer);
+    }
     ImGui::Separator();
     // TODO: check if this is possible to set this layer as edit target of the stage
     if (ImGui::MenuItem("Set Edit target")) {
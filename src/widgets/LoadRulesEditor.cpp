@@ -0,0 +1,192 @@
+#include <iterator>
+#include <map>
+#include <set>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/usd/ar/resolver.h>
+#include <pxr/usd/ar/resolverContextBinder.h>
+#include <pxr/usd/usd/stageLoadRules.h>
+#include "LoadRulesEditor.h"
+#include "PayloadLoader.h"
+#include "Gui.h"
+#include "Constants.h"
+#include "Commands.h"
+#include "ImGuiHelpers.h"
+
+///
+/// The rules are edited without touching the stage. Applying them replaces the load rules of the stage in one call,
+/// so loading thousands of prims costs a single recomposition instead of one per prim.
+///
+
+/// Estimated cost of loading the pending rules. Only the payload layers are counted, the layers they bring are
+/// only known once they are opened
+struct LoadRulesCost {
+    size_t numPayloads = 0;
+    size_t numLayers = 0;
+    size_t numUnresolved = 0;
+    int64_t numBytes = 0;
+};
+
+struct LoadRulesEditorState {
+    std::map<SdfPath, UsdStageLoadRules::Rule> rules; // Pending rules
+    LoadRulesCost cost;
+    bool costIsValid = false;
+};
+
+static const char *GetRuleName(UsdStageLoadRules::Rule rule) {
+    switch (rule) {
+    case UsdStageLoadRules::AllRule:
+        return "Load";
+    case UsdStageLoadRules::OnlyRule:
+        return "Load only";
+    case UsdStageLoadRules::NoneRule:
+        return "Unload";
+    }
+    return "";
+}
+
+static LoadRulesCost EstimateLoadRulesCost(const UsdStageRefPtr &stage, const LoadRulesEditorState &state) {
+    LoadRulesCost cost;
+    std::vector<std::string> assetPaths;
+    for (const auto &rule : state.rules) {
+        const UsdPrim prim = stage->GetPrimAtPath(rule.first);
+        // Load only doesn't load the payloads under a loaded prim
+        if (!prim || rule.second == UsdStageLoadRules::NoneRule ||
+            (rule.second == UsdStageLoadRules::OnlyRule && prim.IsLoaded())) {
+            continue;
+        }
+        CollectPayloadAssetPaths(prim, assetPaths);
+    }
+    cost.numPayloads = assetPaths.size();
+    const std::set<std::string> layers(assetPaths.begin(), assetPaths.end());
+    cost.numLayers = layers.size();
+    ArResolverContextBinder binder(stage->GetPathResolverContext());
+    for (const auto &assetPath : layers) {
+        const std::string resolvedPath = ArGetResolver().Resolve(assetPath);
+        const int64_t fileLength = resolvedPath.empty() ? -1 : ArchGetFileLength(resolvedPath.c_str());
+        if (fileLength < 0) {
+            cost.numUnresolved++;
+        } else {
+            cost.numBytes += fileLength;
+        }
+    }
+    return cost;
+}
+
+static void AddSelectedPaths(const Selection &selectedPaths, UsdStageLoadRules::Rule rule, LoadRulesEditorState &state) {
+    for (const auto &path : GetSelectedPaths(selectedPaths)) {
+        state.rules[path] = rule;
+    }
+    state.costIsValid = false;
+}
+
+static void DrawPendingRules(LoadRulesEditorState &state) {
+    if (ImGui::BeginTable("##DrawPendingLoadRules", 3, ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg)) {
+        TableSetupColumns("", "Rule", "Path");
+        ImGui::TableHeadersRow();
+        SdfPath removedPath;
+        int buttonId = 0;
+        for (auto &rule : state.rules) {
+            ImGui::TableNextRow();
+            ImGui::PushID(buttonId++);
+            ImGui::TableSetColumnIndex(0);
+            if (ImGui::SmallButton(ICON_DELETE)) {
+                removedPath = rule.first;
+            }
+            ImGui::TableSetColumnIndex(1);
+            ImGui::PushItemWidth(ImGui::GetFontSize() * 7);
+            if (ImGui::BeginCombo("##Rule", GetRuleName(rule.second))) {
+                for (const auto ruleValue : {UsdStageLoadRules::AllRule, UsdStageLoadRules::OnlyRule, UsdStageLoadRules::NoneRule}) {
+                    if (ImGui::Selectable(GetRuleName(ruleValue), rule.second == ruleValue)) {
+                        rule.second = ruleValue;
+                        state.costIsValid = false;
+                    }
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::PopItemWidth();
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%s", rule.first.GetText());
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+        if (!removedPath.IsEmpty()) {
+            state.rules.erase(removedPath);
+            state.costIsValid = false;
+        }
+    }
+}
+
+void DrawLoadRulesEditor(UsdStageRefPtr stage, const Selection &selectedPaths) {
+    if (!stage)
+        return;
+    static std::map<UsdStageWeakPtr, LoadRulesEditorState> loadRulesStates;
+    // The rules of the released stages are dropped
+    for (auto rulesState = loadRulesStates.begin(); rulesState != loadRulesStates.end();) {
+        rulesState = rulesState->first.IsInvalid() ? loadRulesStates.erase(rulesState) : std::next(rulesState);
+    }
+    LoadRulesEditorState &state = loadRulesStates[stage];
+
+    ImGui::Text("Add the selected prims as:");
+    ImGui::SameLine();
+    if (ImGui::Button("Load")) {
+        AddSelectedPaths(selectedPaths, UsdStageLoadRules::AllRule, state);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load only")) {
+        AddSelectedPaths(selectedPaths, UsdStageLoadRules::OnlyRule, state);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Unload")) {
+        AddSelectedPaths(selectedPaths, UsdStageLoadRules::NoneRule, state);
+    }
+
+    DrawPendingRules(state);
+    if (state.rules.empty()) {
+        return;
+    }
+
+    // The estimation traverses the loaded part of the rules hierarchies, it is only computed on demand
+    if (ImGui::Button("Estimate cost")) {
+        state.cost = EstimateLoadRulesCost(stage, state);
+        state.costIsValid = true;
+    }
+    if (state.costIsValid) {
+        ImGui::SameLine();
+        ImGui::Text("%zu payloads, %zu layers, %.1f MB on disk", state.cost.numPayloads, state.cost.numLayers,
+                    state.cost.numBytes / (1024.0 * 1024.0));
+        if (state.cost.numUnresolved) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1.0, 0.3, 0.3, 1.0), "%zu unresolved", state.cost.numUnresolved);
+        }
+    }
+
+    if (ImGui::Button("Apply")) {
+        // The rules are applied on the current ones, the stage is recomposed once. As the outliner load and unload,
+        // a rule replaces the rules of the descendants
+        UsdStageLoadRules loadRules = stage->GetLoadRules();
+        for (const auto &rule : state.rules) {
+            switch (rule.second) {
+            case UsdStageLoadRules::AllRule:
+                loadRules.LoadWithDescendants(rule.first);
+                break;
+            case UsdStageLoadRules::OnlyRule:
+                loadRules.LoadWithoutDescendants(rule.first);
+                break;
+            case UsdStageLoadRules::NoneRule:
+                loadRules.Unload(rule.first);
+                break;
+            }
+        }
+        loadRules.Minimize();
+        // The pending rules are kept if the call is dropped
+        if (ExecuteAfterDraw(&UsdStage::SetLoadRules, stage, loadRules)) {
+            state.rules.clear();
+            state.costIsValid = false;
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+        state.rules.clear();
+        state.costIsValid = false;
+    }
+}
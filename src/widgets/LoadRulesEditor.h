@@ -0,0 +1,9 @@
+#pragma once
+#include <pxr/usd/usd/stage.h>
+#include "Selection.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+/// Draw the load rules waiting to be applied on the stage. The selected prims are added as load, load only or unload
+/// rules, the cost of the loads can be estimated, and all the rules are applied at once with a single recomposition
+void DrawLoadRulesEditor(UsdStageRefPtr stage, const Selection &selectedPaths);
@@ -1,6 +1,18 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
 
+#include <pxr/usd/sdf/pathTable.h>
+#include <pxr/usd/usd/modelAPI.h>
+#include <pxr/usd/usd/notice.h>
+#include <pxr/usd/usd/primRange.h>
 #include <pxr/usd/usdGeom/gprim.h>
+#include <pxr/usd/usdGeom/tokens.h>
 #include <pxr/usd/pcp/layerStack.h>
 
 #include "Gui.h"
@@ -8,9 +20,14 @@
 #include "Commands.h"
 #include "ValueEditor.h"
 #include "Constants.h"
+#include "PrimSearch.h"
+#include "CompositionCost.h"
+#include "DescendantCounts.h"
+#include "ModalDialogs.h"
 
 ///
-/// Note: ImGuiListClipper can be useful if the hierarchy is huge
+/// The outliner draws a flattened array of the unfolded prims with an ImGuiListClipper, so only the rows on screen
+/// cost something each frame
 ///
 
 static void ExploreLayerTree(SdfLayerTreeHandle tree, PcpNodeRef node) {
@@ -42,11 +59,12 @@ static void DrawUsdPrimEditMenuItems(const UsdPrim &prim) {
         const bool active = !prim.IsActive();
         ExecuteAfterDraw(&UsdPrim::SetActive, prim, active);
     }
+    // The payloads are loaded in the background, the stage is modified when they are ready
     if (prim.HasAuthoredPayloads() && prim.IsLoaded() && ImGui::MenuItem("Unload")) {
-        ExecuteAfterDraw(&UsdPrim::Unload, prim);
+        ExecuteAfterDraw<EditorUnloadPayload>(prim);
     }
     if (prim.HasAuthoredPayloads() && !prim.IsLoaded() && ImGui::MenuItem("Load")) {
-        ExecuteAfterDraw(&UsdPrim::Load, prim, UsdLoadWithDescendants);
+        ExecuteAfterDraw<EditorLoadPayload>(prim);
     }
     if (ImGui::MenuItem("Copy prim path")) {
         ImGui::SetClipboardText(prim.GetPath().GetString().c_str());
@@ -62,108 +80,1123 @@ static void DrawUsdPrimEditMenuItems(const UsdPrim &prim) {
     }
 }
 
-/// Recursive function to draw a prim and its descendants
-static void DrawPrimTreeNode(const UsdPrim &prim, Selection &selectedPaths) {
-    ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow;
-    if (prim.GetAllChildren().empty()) {
-        flags |= ImGuiTreeNodeFlags_Leaf;
+/// The prims outside of the population mask of the stage are not composed, the mask can be expanded from here.
+/// The children outside of the mask are only known from the specs of the prim.
+static void DrawPopulationMaskMenuItems(const UsdPrim &prim) {
+    const UsdStageWeakPtr stage = prim.GetStage();
+    const UsdStagePopulationMask mask = stage->GetPopulationMask();
+    if (mask.IncludesSubtree(prim.GetPath()) || !ImGui::BeginMenu("Population mask")) {
+        return;
     }
-    if (IsSelected(selectedPaths, prim.GetPath())) {
-        flags |= ImGuiTreeNodeFlags_Selected;
+    if (ImGui::MenuItem("Include all descendants")) {
+        ExecuteAfterDraw(&UsdStage::SetPopulationMask, stage, mask.GetUnion(prim.GetPath()));
     }
-    if (!prim.IsActive()) {
-        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(PrimInactiveColor));
+    std::set<TfToken> maskedChildren;
+    for (const auto &spec : prim.GetPrimStack()) {
+        for (const auto &child : spec->GetNameChildren()) {
+            if (!mask.Includes(prim.GetPath().AppendChild(child->GetNameToken()))) {
+                maskedChildren.insert(child->GetNameToken());
+            }
+        }
+    }
+    if (!maskedChildren.empty()) {
+        ImGui::Separator();
+    }
+    for (const auto &child : maskedChildren) {
+        if (ImGui::MenuItem(child.GetText())) {
+            ExecuteAfterDraw(&UsdStage::SetPopulationMask, stage, mask.GetUnion(prim.GetPath().AppendChild(child)));
+        }
+    }
+    ImGui::EndMenu();
+}
+
+/// Row of the outliner. The rows of the unfolded prims are flattened in an array in depth first order, so drawing
+/// doesn't have to traverse the stage. The displayed columns are in the OutlinerDisplayCache
+struct OutlinerRow {
+    UsdPrim prim;
+    int depth = 0;
+    size_t subtreeSize = 1; // Number of rows of the subtree, the row included
+    bool hasChildren = false;
+    size_t numInstances = 0; // Prototype rows of the prototypes view
+    bool showPath = false;   // Instance rows of the prototypes view, the instances come from anywhere in the stage
+};
+
+/// The children of the instances are their instance proxies, they are only traversed when the instance is unfolded
+static UsdPrimSiblingRange GetOutlinerChildren(const UsdPrim &prim) {
+    return prim.GetFilteredChildren(UsdTraverseInstanceProxies(UsdPrimAllPrimsPredicate));
+}
+
+static void UpdateOutlinerRowChildren(OutlinerRow &row) { row.hasChildren = !GetOutlinerChildren(row.prim).empty(); }
+
+/// Displayed columns of a prim
+struct PrimDisplayInfo {
+    TfToken typeName;
+    TfToken kind;
+    UsdAttribute visibilityAttr;           // Invalid if the prim is not imageable
+    TfToken visibility;                    // Authored visibility, only used when it is not time varying
+    bool ownVisibilityIsTimeVarying = false;
+    bool visibilityIsTimeVarying = false;  // The visibility of the prim or of one of its ancestors might be animated
+    bool active = true;
+    bool hasPayload = false;
+    bool isTimeVarying = false;            // One of the attributes might be animated
+    bool isValid = false;                  // The columns must be read again
+
+    // Inherited visibility, resolved at computedTime
+    bool computedIsValid = false;
+    bool invisible = false;
+    bool inheritedInvisible = false;       // Hidden by an ancestor
+    UsdTimeCode computedTime = UsdTimeCode::Default();
+};
+
+///
+/// Cache of the displayed columns of the prims, keyed by path. The prims are read only when their row is drawn, and
+/// again when a notice invalidates them. The computed visibility is resolved again only when the time changes and
+/// the visibility of the prim or of one of its ancestors is animated.
+///
+class OutlinerDisplayCache {
+  public:
+    const PrimDisplayInfo &Get(const UsdPrim &prim, UsdTimeCode time) {
+        // The entries of a path table are not moved when the table grows, the reference is kept while filling the parents
+        PrimDisplayInfo &info = _infos[prim.GetPath()];
+        if (!info.isValid) {
+            Fill(prim, info);
+        }
+        if (!info.computedIsValid || (info.visibilityIsTimeVarying && info.computedTime != time)) {
+            ComputeVisibility(prim, time, info);
+        }
+        return info;
     }
 
-    auto unfolded = ImGui::TreeNodeEx(prim.GetName().GetText(), flags);
-    if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen()) {
-        SetSelected(selectedPaths, prim.GetPath());
+    /// The prim columns have changed
+    void InvalidatePrim(const SdfPath &path) {
+        auto it = _infos.find(path);
+        if (it != _infos.end()) {
+            it->second.isValid = false;
+            it->second.computedIsValid = false;
+        }
     }
-    if (ImGui::BeginPopupContextItem()) {
-        DrawUsdPrimEditMenuItems(prim);
-        ImGui::EndPopup();
+
+    /// The prim and its descendants have changed, or the visibility they inherit
+    void InvalidateSubtree(const SdfPath &path) {
+        auto it = _infos.find(path);
+        if (it != _infos.end()) {
+            _infos.erase(it);
+        }
     }
 
-    ImGui::NextColumn();
+    void Clear() { _infos.clear(); }
+
+  private:
+    static void Fill(const UsdPrim &prim, PrimDisplayInfo &info) {
+        info = PrimDisplayInfo();
+        info.isValid = true;
+        if (prim.IsPseudoRoot()) {
+            return;
+        }
+        info.typeName = prim.GetTypeName();
+        UsdModelAPI(prim).GetKind(&info.kind);
+        info.active = prim.IsActive();
+        info.hasPayload = prim.HasAuthoredPayloads();
+        for (const auto &attribute : prim.GetAttributes()) {
+            if (attribute.ValueMightBeTimeVarying()) {
+                info.isTimeVarying = true;
+                break;
+            }
+        }
+        info.visibility = UsdGeomTokens->inherited;
+        UsdGeomImageable imageable(prim);
+        if (imageable) {
+            info.visibilityAttr = imageable.GetVisibilityAttr();
+            info.ownVisibilityIsTimeVarying = info.visibilityAttr.ValueMightBeTimeVarying();
+            if (!info.ownVisibilityIsTimeVarying) {
+                info.visibilityAttr.Get(&info.visibility);
+            }
+        }
+    }
 
-    // Get visibility parameter.
-    // Is it really useful ???
-    UsdGeomImageable imageable(prim);
-    const char *icon = "";
-    if (imageable) {
-        VtValue visible;
-        imageable.GetVisibilityAttr().Get(&visible);
-        icon = visible == TfToken("invisible") ? ICON_FA_EYE_SLASH : ICON_FA_EYE;
+    void ComputeVisibility(const UsdPrim &prim, UsdTimeCode time, PrimDisplayInfo &info) {
+        info.inheritedInvisible = false;
+        info.visibilityIsTimeVarying = info.ownVisibilityIsTimeVarying;
+        if (!prim.IsPseudoRoot()) {
+            const PrimDisplayInfo &parentInfo = Get(prim.GetParent(), time);
+            info.inheritedInvisible = parentInfo.invisible;
+            info.visibilityIsTimeVarying |= parentInfo.visibilityIsTimeVarying;
+        }
+        TfToken visibility = info.visibility;
+        if (info.ownVisibilityIsTimeVarying) {
+            info.visibilityAttr.Get(&visibility, time);
+        }
+        info.invisible = info.inheritedInvisible || visibility == UsdGeomTokens->invisible;
+        info.computedTime = time;
+        info.computedIsValid = true;
     }
 
-    ImGui::Text("%s %s", icon, prim.GetTypeName().GetText());
+    SdfPathTable<PrimDisplayInfo> _infos;
+};
 
-    if (!prim.IsActive()) {
-        ImGui::PopStyleColor();
+///
+/// Filtered view of the outliner: the prims found by the background search and their ancestors, all unfolded
+///
+struct OutlinerFilter {
+    char query[256] = "";
+    bool isRegex = false;
+    bool isValid = true;      // The query is a valid expression
+    bool mustRestart = false; // The hierarchy has changed since the search started
+    PrimSearch search;
+    SdfPathSet shownPaths; // Found paths with their ancestors, the order of SdfPath is a depth first order
+    size_t numFound = 0;
+    std::vector<OutlinerRow> rows;
+    bool rowsAreValid = true;
+    double lastRowsUpdate = 0.0;
+};
+
+///
+/// Composition cost column: the cost of each prim is computed by a background scan of the stage and kept until the
+/// prim is resynced. The resynced subtrees are scanned again.
+///
+struct OutlinerCompositionCost {
+    bool isShown = false;
+    CompositionCostScan scan;
+    SdfPathTable<PrimCompositionCost> costs; // The ancestors of the scanned prims might not be valid yet
+    SdfPathVector pendingRoots;             // Subtrees to scan
+    SdfPathVector resyncedPaths;            // Pending invalidations
+    uint32_t maxNodes = 1;                  // Hottest prim of the heatmap
+
+    // Costliest prims, sorted by the selected column of the hotspots table
+    std::vector<CompositionCostScan::Result> hotspots;
+    bool hotspotsAreValid = false;
+    double lastHotspotsUpdate = 0.0;
+    int sortColumn = 1;
+    bool sortAscending = false;
+};
+
+/// Above this number of changed subtrees, the rows are rebuilt instead of patched
+static constexpr size_t MaxPatchedSubtrees = 32;
+
+///
+/// Outliner model of a stage: the unfolded prims and the rows to draw.
+/// It listens to the stage notices and patches only the rows of the resynced subtrees, the rows of the prims with
+/// info only changes are updated in place. The changes are applied before drawing, not in the notice callback.
+///
+class StageOutlinerState : public TfWeakBase {
+  public:
+    StageOutlinerState(const UsdStageRefPtr &stage) : _stage(stage) {
+        _noticeKey = TfNotice::Register(TfCreateWeakPtr(this), &StageOutlinerState::OnObjectsChanged, UsdStageWeakPtr(stage));
     }
+    ~StageOutlinerState() { TfNotice::Revoke(_noticeKey); }
 
-    ImGui::NextColumn(); // Back to the first column
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+        if (filter.query[0] && !notice.GetResyncedPaths().empty()) {
+            filter.mustRestart = true;
+        }
+        if (compositionCost.isShown) {
+            for (const auto &path : notice.GetResyncedPaths()) {
+                if (!path.IsPropertyPath()) {
+                    compositionCost.resyncedPaths.push_back(path);
+                }
+            }
+        }
+        if (_descendantCounter.IsComputed()) {
+            for (const auto &path : notice.GetResyncedPaths()) {
+                if (!path.IsPropertyPath()) {
+                    _countResyncs.push_back(path);
+                }
+            }
+        }
+        if (!_rowsAreValid)
+            return;
+        if (!notice.GetResyncedPaths().empty()) {
+            _prototypesAreValid = false;
+        }
+        for (const auto &path : notice.GetResyncedPaths()) {
+            // A new or removed property doesn't change the hierarchy
+            if (path.IsPrimPropertyPath()) {
+                InvalidateDisplay(path);
+            } else {
+                _resyncedPaths.push_back(path);
+                _invalidSubtrees.push_back(path);
+            }
+        }
+        for (const auto &path : notice.GetChangedInfoOnlyPaths()) {
+            InvalidateDisplay(path);
+        }
+    }
+
+    bool IsUnfolded(const SdfPath &path) const {
+        const auto it = _unfoldedPaths.find(path);
+        return it != _unfoldedPaths.end() && it->second;
+    }
+
+    void SetUnfolded(const SdfPath &path, bool unfolded) {
+        if (SetUnfoldedFlag(path, unfolded)) {
+            _resyncedPaths.push_back(path);
+            _prototypeRowsAreValid = false;
+        }
+    }
+
+    /// Unfold the prim and all its descendants having children
+    void UnfoldSubtree(const UsdPrim &prim) {
+        for (const auto &descendant : UsdPrimRange(prim, UsdTraverseInstanceProxies(UsdPrimAllPrimsPredicate))) {
+            if (!GetOutlinerChildren(descendant).empty()) {
+                SetUnfoldedFlag(descendant.GetPath(), true);
+            }
+        }
+        _resyncedPaths.push_back(prim.GetPath());
+        _prototypeRowsAreValid = false;
+    }
+
+    /// Unfold the descendants of the prim down to depth levels under it. The levels are unfolded one after the other
+    /// until the rows they add exceed the budget, so unfolding a huge hierarchy stops after the first levels
+    void UnfoldToDepth(const UsdPrim &prim, int depth, size_t rowBudget) {
+        std::vector<UsdPrim> level{prim};
+        std::vector<UsdPrim> nextLevel;
+        size_t numRows = 0;
+        for (int levelIndex = 0; levelIndex < depth && !level.empty(); ++levelIndex) {
+            nextLevel.clear();
+            for (const auto &levelPrim : level) {
+                const auto children = GetOutlinerChildren(levelPrim);
+                const size_t numChildren = std::distance(children.begin(), children.end());
+                if (numChildren == 0 || !levelPrim.IsActive()) {
+                    continue;
+                }
+                numRows += numChildren;
+                if (numRows > rowBudget) {
+                    break;
+                }
+                SetUnfoldedFlag(levelPrim.GetPath(), true);
+                nextLevel.insert(nextLevel.end(), children.begin(), children.end());
+            }
+            if (numRows > rowBudget) {
+                break;
+            }
+            level.swap(nextLevel);
+        }
+        _resyncedPaths.push_back(prim.GetPath());
+        _prototypeRowsAreValid = false;
+    }
+
+    /// Unfold the ancestors of the paths, walking up each path once. The rows are patched or rebuilt once for all the
+    /// paths in UpdateRows. The paths are revealed in order until the rows added by the unfolded prims exceed the budget
+    void RevealPaths(const SdfPathVector &paths, size_t rowBudget) {
+        size_t numRows = 0;
+        for (const auto &path : paths) {
+            for (SdfPath parent = path.GetParentPath(); !parent.IsEmpty(); parent = parent.GetParentPath()) {
+                if (IsUnfolded(parent)) {
+                    continue; // An ancestor further up might still be folded
+                }
+                const UsdPrim prim = _stage->GetPrimAtPath(parent);
+                if (!prim) {
+                    continue;
+                }
+                const auto children = GetOutlinerChildren(prim);
+                numRows += std::distance(children.begin(), children.end());
+                if (numRows > rowBudget) {
+                    return;
+                }
+                SetUnfolded(parent, true);
+            }
+        }
+    }
+
+    /// Counts of the descendants of the prim at path. Returns false until the background count is finished
+    bool GetDescendantCounts(const SdfPath &path, PrimCounts &counts) const {
+        return _descendantCounter.GetDescendantCounts(path, counts);
+    }
+    bool AreDescendantsCounted() const { return _descendantCounter.IsComputed(); }
+
+    bool IsShowingPrototypes() const { return _showPrototypes; }
+    void SetShowPrototypes(bool showPrototypes) {
+        _showPrototypes = showPrototypes;
+        _prototypeRowsAreValid = false;
+    }
+
+    /// How much the instancing saves: the prims under the prototypes are composed once instead of once per instance
+    struct PrototypesSummary {
+        size_t numPrototypes = 0;
+        size_t numInstances = 0;
+        size_t numPrototypePrims = 0; // Composed prims under the prototypes
+        size_t numInstancedPrims = 0; // Prims the instances would have without instancing
+    };
+    const PrototypesSummary &GetPrototypesSummary() const { return _prototypesSummary; }
+
+    /// Apply the pending changes to the rows and to the display cache
+    void UpdateRows() {
+        if (!_rowsAreValid) {
+            _displayCache.Clear();
+            _rows.clear();
+            AppendRows(_stage->GetPseudoRoot(), 0, _rows);
+            _rowsAreValid = true;
+        } else if (!_resyncedPaths.empty()) {
+            SdfPath::RemoveDescendentPaths(&_resyncedPaths);
+            if (_resyncedPaths.size() > MaxPatchedSubtrees) {
+                // Each patch moves the rows following it, rebuilding them all at once is cheaper
+                _rows.clear();
+                AppendRows(_stage->GetPseudoRoot(), 0, _rows);
+            } else {
+                // The removed prims first, so the new prims are inserted after siblings which still exist
+                for (const auto &path : _resyncedPaths) {
+                    if (!_stage->GetPrimAtPath(path)) {
+                        PatchRows(path);
+                    }
+                }
+                for (const auto &path : _resyncedPaths) {
+                    if (_stage->GetPrimAtPath(path)) {
+                        PatchRows(path);
+                    }
+                }
+            }
+        }
+        SdfPath::RemoveDescendentPaths(&_invalidSubtrees);
+        for (const auto &path : _invalidSubtrees) {
+            _displayCache.InvalidateSubtree(path);
+        }
+        for (const auto &path : _invalidPrims) {
+            _displayCache.InvalidatePrim(path);
+        }
+        if (!_resyncedPaths.empty()) {
+            _prototypeRowsAreValid = false;
+        }
+        if (_showPrototypes && (!_prototypeRowsAreValid || !_prototypesAreValid)) {
+            UpdatePrototypeRows();
+        }
+        _resyncedPaths.clear();
+        _invalidSubtrees.clear();
+        _invalidPrims.clear();
+        if (!_countResyncs.empty()) {
+            _descendantCounter.Update(_stage, std::move(_countResyncs));
+            _countResyncs.clear();
+        }
+        UpdateDescendantCounter();
+    }
+
+    const std::vector<OutlinerRow> &GetRows() const { return _showPrototypes ? _prototypeRows : _rows; }
+
+    const PrimDisplayInfo &GetDisplayInfo(const UsdPrim &prim, UsdTimeCode time) { return _displayCache.Get(prim, time); }
+
+    OutlinerFilter filter;
+    OutlinerCompositionCost compositionCost;
+    bool showDescendantCounts = false;
+
+  private:
+    /// The stage is counted in the background the first time the counts are shown. An interrupted count restarts
+    /// once the edits are finished
+    void UpdateDescendantCounter() {
+        _descendantCounter.FetchResults();
+        if (showDescendantCounts && !_descendantCounter.IsComputed() && !_descendantCounter.IsRunning() &&
+            !IsStageEditLocked()) {
+            _descendantCounter.Start(_stage);
+        }
+    }
+
+    /// Change the flag without updating the rows, returns true if it was changed. The folded paths are kept in the
+    /// table, the paths are only added
+    bool SetUnfoldedFlag(const SdfPath &path, bool unfolded) {
+        if (IsUnfolded(path) == unfolded) {
+            return false;
+        }
+        _unfoldedPaths[path] = unfolded;
+        return true;
+    }
+
+    /// Queue the invalidation of the displayed columns changed by a modification of path
+    void InvalidateDisplay(const SdfPath &path) {
+        if (path.IsPropertyPath() && path.GetNameToken() == UsdGeomTokens->visibility) {
+            // The descendants inherit the visibility
+            _invalidSubtrees.push_back(path.GetPrimPath());
+        } else {
+            _invalidPrims.push_back(path.GetPrimPath());
+        }
+    }
+
+    /// Append the row of the prim and the rows of its unfolded descendants, in depth first order.
+    /// The traversal uses its own stack, the depth of the hierarchy doesn't matter
+    void AppendRows(const UsdPrim &prim, int depth, std::vector<OutlinerRow> &rows) const {
+        const size_t firstRow = rows.size();
+        std::vector<std::pair<UsdPrim, int>> pendingPrims{{prim, depth}};
+        while (!pendingPrims.empty()) {
+            OutlinerRow row;
+            row.prim = std::move(pendingPrims.back().first);
+            row.depth = pendingPrims.back().second;
+            pendingPrims.pop_back();
+            UpdateOutlinerRowChildren(row);
+            rows.push_back(row);
+            if (row.hasChildren && row.prim.IsActive() && IsUnfolded(row.prim.GetPath())) {
+                // The children are pushed in reverse order to be popped in order
+                const size_t firstChild = pendingPrims.size();
+                for (const auto &child : GetOutlinerChildren(row.prim)) {
+                    pendingPrims.emplace_back(child, row.depth + 1);
+                }
+                std::reverse(pendingPrims.begin() + firstChild, pendingPrims.end());
+            }
+        }
+        // A row is closed by the next row which is not deeper
+        std::vector<size_t> openRows;
+        for (size_t rowIndex = firstRow; rowIndex < rows.size(); ++rowIndex) {
+            while (!openRows.empty() && rows[openRows.back()].depth >= rows[rowIndex].depth) {
+                rows[openRows.back()].subtreeSize = rowIndex - openRows.back();
+                openRows.pop_back();
+            }
+            openRows.push_back(rowIndex);
+        }
+        for (const auto openRow : openRows) {
+            rows[openRow].subtreeSize = rows.size() - openRow;
+        }
+    }
+
+    /// Rows of the prototypes view: the prototypes with their instances when they are unfolded, and the instance
+    /// proxies of the unfolded instances. The rows are rebuilt when something changes, there is one row per prototype
+    /// and the instances are listed only for the unfolded prototypes.
+    void UpdatePrototypeRows() {
+        if (!_prototypesAreValid) {
+            _prototypes.clear();
+            _prototypesSummary = PrototypesSummary();
+            for (const auto &prototype : _stage->GetPrototypes()) {
+                PrototypeInfo info;
+                info.prototype = prototype;
+                info.instances = prototype.GetInstances();
+                std::sort(info.instances.begin(), info.instances.end(),
+                          [](const UsdPrim &a, const UsdPrim &b) { return a.GetPath() < b.GetPath(); });
+                // The prototype root stands for the instance prims, which are composed for each instance
+                const auto range = UsdPrimRange(prototype, UsdPrimAllPrimsPredicate);
+                const size_t numPrims = std::distance(range.begin(), range.end()) - 1;
+                _prototypesSummary.numPrototypes++;
+                _prototypesSummary.numInstances += info.instances.size();
+                _prototypesSummary.numPrototypePrims += numPrims;
+                _prototypesSummary.numInstancedPrims += numPrims * info.instances.size();
+                _prototypes.push_back(std::move(info));
+            }
+            _prototypesAreValid = true;
+        }
+        _prototypeRows.clear();
+        for (const auto &info : _prototypes) {
+            OutlinerRow row;
+            row.prim = info.prototype;
+            row.hasChildren = !info.instances.empty();
+            row.numInstances = info.instances.size();
+            _prototypeRows.push_back(row);
+            if (row.hasChildren && IsUnfolded(info.prototype.GetPath())) {
+                for (const auto &instance : info.instances) {
+                    const size_t instanceRow = _prototypeRows.size();
+                    AppendRows(instance, 1, _prototypeRows);
+                    _prototypeRows[instanceRow].showPath = true;
+                }
+            }
+        }
+        _prototypeRowsAreValid = true;
+    }
+
+    /// Index of the row of path, the number of rows if there is none. The row is searched from the pseudo root, among
+    /// the children rows of each ancestor, skipping the subtrees of the siblings. The rows of the ancestors found are
+    /// returned in ancestorRows, from the pseudo root to the parent if it is drawn.
+    size_t FindRow(const SdfPath &path, std::vector<size_t> &ancestorRows) const {
+        ancestorRows.clear();
+        if (_rows.empty()) {
+            return _rows.size();
+        }
+        size_t rowIndex = 0; // The pseudo root
+        for (const auto &prefix : path.GetPrefixes()) {
+            ancestorRows.push_back(rowIndex);
+            const size_t rowEnd = EndOfSubtree(rowIndex);
+            const TfToken &name = prefix.GetNameToken();
+            for (++rowIndex; rowIndex < rowEnd && _rows[rowIndex].prim.GetName() != name; rowIndex = EndOfSubtree(rowIndex)) {
+            }
+            if (rowIndex == rowEnd) {
+                return _rows.size();
+            }
+        }
+        return rowIndex;
+    }
+
+    /// Index following the last row of the subtree of the row at rowIndex
+    size_t EndOfSubtree(size_t rowIndex) const { return rowIndex + _rows[rowIndex].subtreeSize; }
+
+    /// Replace the rows of the subtree at path with the current state of the stage
+    void PatchRows(const SdfPath &path) {
+        if (path.IsAbsoluteRootPath()) {
+            _rows.clear();
+            AppendRows(_stage->GetPseudoRoot(), 0, _rows);
+            return;
+        }
+        const UsdPrim prim = _stage->GetPrimAtPath(path);
+        std::vector<size_t> ancestorRows;
+        size_t rowIndex = FindRow(path, ancestorRows);
+        size_t rowEnd = rowIndex;
+        int depth = 0;
+        // The parent row is drawn if all the ancestors were found
+        const bool parentIsDrawn = ancestorRows.size() == path.GetPathElementCount();
+        if (rowIndex != _rows.size()) {
+            rowEnd = EndOfSubtree(rowIndex);
+            depth = _rows[rowIndex].depth;
+        } else if (prim && parentIsDrawn) {
+            // New prim, it is drawn only if its parent is unfolded. Its rows go after the subtree of its previous sibling
+            const size_t parentIndex = ancestorRows.back();
+            UpdateOutlinerRowChildren(_rows[parentIndex]);
+            if (!_rows[parentIndex].prim.IsActive() || !IsUnfolded(path.GetParentPath())) {
+                return;
+            }
+            depth = _rows[parentIndex].depth + 1;
+            rowIndex = parentIndex + 1;
+            for (const auto &sibling : GetOutlinerChildren(prim.GetParent())) {
+                if (sibling == prim) {
+                    break;
+                }
+                if (rowIndex < _rows.size() && _rows[rowIndex].prim.GetPath() == sibling.GetPath()) {
+                    rowIndex = EndOfSubtree(rowIndex);
+                }
+            }
+            rowEnd = rowIndex;
+        } else {
+            return; // Prim which wasn't drawn
+        }
 
-    if (unfolded) {
-        if (prim.IsActive()) {
-            for (const auto &child : prim.GetAllChildren()) {
-                DrawPrimTreeNode(child, selectedPaths);
+        std::vector<OutlinerRow> newRows;
+        if (prim) {
+            AppendRows(prim, depth, newRows);
+        }
+        const size_t numOldRows = rowEnd - rowIndex;
+        if (newRows.size() == numOldRows) {
+            std::move(newRows.begin(), newRows.end(), _rows.begin() + rowIndex);
+        } else {
+            _rows.erase(_rows.begin() + rowIndex, _rows.begin() + rowEnd);
+            _rows.insert(_rows.begin() + rowIndex, std::make_move_iterator(newRows.begin()),
+                         std::make_move_iterator(newRows.end()));
+            // The ancestors are before the patched rows, their indices didn't change
+            for (const auto ancestorRow : ancestorRows) {
+                _rows[ancestorRow].subtreeSize = _rows[ancestorRow].subtreeSize + newRows.size() - numOldRows;
+            }
+        }
+
+        // The parent might have gained its first child or lost its last one
+        if ((!prim || numOldRows == 0) && parentIsDrawn) {
+            UpdateOutlinerRowChildren(_rows[ancestorRows.back()]);
+        }
+    }
+
+    UsdStageWeakPtr _stage; // The state is deleted when the stage is released
+    TfNotice::Key _noticeKey;
+    SdfPathTable<bool> _unfoldedPaths; // Unfolded state of the prims, owned by the outliner instead of imgui
+    std::vector<OutlinerRow> _rows;
+    bool _rowsAreValid = false;
+    SdfPathVector _resyncedPaths;   // Pending subtree updates
+    OutlinerDisplayCache _displayCache;
+    SdfPathVector _invalidSubtrees; // Pending display cache invalidations
+    SdfPathVector _invalidPrims;
+    DescendantCounter _descendantCounter; // Counted the first time the counts are shown
+    SdfPathVector _countResyncs;          // Pending count updates
+
+    // Prototypes view
+    struct PrototypeInfo {
+        UsdPrim prototype;
+        std::vector<UsdPrim> instances;
+    };
+    bool _showPrototypes = false;
+    std::vector<PrototypeInfo> _prototypes;
+    bool _prototypesAreValid = false; // The prototypes and their instances must be read again
+    PrototypesSummary _prototypesSummary;
+    std::vector<OutlinerRow> _prototypeRows;
+    bool _prototypeRowsAreValid = false;
+};
+
+static StageOutlinerState &GetStageOutlinerState(const UsdStageRefPtr &stage) {
+    static std::map<UsdStageWeakPtr, std::unique_ptr<StageOutlinerState>> outlinerStates;
+    // The states of the released stages are deleted
+    for (auto outlinerState = outlinerStates.begin(); outlinerState != outlinerStates.end();) {
+        outlinerState = outlinerState->first.IsInvalid() ? outlinerStates.erase(outlinerState) : std::next(outlinerState);
+    }
+    auto &state = outlinerStates[stage];
+    if (!state) {
+        state.reset(new StageOutlinerState(stage));
+    }
+    return *state;
+}
+
+/// Draw the filter bar, restart the search when the query or the stage have changed and collect the results
+static void DrawOutlinerFilter(const UsdStageRefPtr &stage, OutlinerFilter &filter) {
+    ImGui::PushItemWidth(-ImGui::GetFontSize() * 12);
+    bool queryChanged = ImGui::InputTextWithHint("##OutlinerFilter", ICON_FA_SEARCH " name, type, kind, schema or /path",
+                                                 filter.query, sizeof(filter.query));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    queryChanged |= ImGui::Checkbox("Regex", &filter.isRegex);
+
+    // An interrupted search restarts once the edits are finished
+    const bool searchIsOutdated =
+        filter.mustRestart || (filter.search.WasInterrupted() && !filter.search.IsRunning());
+    if (queryChanged || (searchIsOutdated && !IsStageEditLocked())) {
+        // The rows might point to removed prims
+        filter.rows.clear();
+        filter.shownPaths.clear();
+        filter.numFound = 0;
+        filter.rowsAreValid = false;
+        filter.mustRestart = false;
+        filter.isValid = filter.search.Start(stage, filter.query, filter.isRegex);
+    }
+
+    SdfPathVector found;
+    if (filter.search.FetchResults(found)) {
+        for (const auto &path : found) {
+            filter.numFound++;
+            for (SdfPath shown = path; !shown.IsEmpty() && filter.shownPaths.insert(shown).second;
+                 shown = shown.GetParentPath()) {
             }
         }
-        ImGui::TreePop();
+        filter.rowsAreValid = false;
+    }
+
+    ImGui::SameLine();
+    if (!filter.isValid) {
+        ImGui::TextColored(ImVec4(1.0, 0.3, 0.3, 1.0), "Invalid");
+    } else if (filter.query[0]) {
+        ImGui::Text("%zu%s", filter.numFound, filter.search.IsRunning() ? "..." : "");
+    }
+
+    // The rows are rebuilt a few times per second while the results are streamed
+    const double now = ImGui::GetTime();
+    if (!filter.rowsAreValid && (!filter.search.IsRunning() || now - filter.lastRowsUpdate > 0.2)) {
+        filter.rows.clear();
+        for (auto shown = filter.shownPaths.begin(); shown != filter.shownPaths.end(); ++shown) {
+            OutlinerRow row;
+            row.prim = stage->GetPrimAtPath(*shown);
+            if (!row.prim) {
+                continue;
+            }
+            row.depth = static_cast<int>(shown->GetPathElementCount());
+            const auto next = std::next(shown);
+            row.hasChildren = next != filter.shownPaths.end() && next->GetParentPath() == *shown;
+            filter.rows.push_back(row);
+        }
+        filter.rowsAreValid = true;
+        filter.lastRowsUpdate = now;
+    }
+}
+
+/// Start, restart after a resync, and collect the background scan of the composition costs
+static void UpdateCompositionCost(const UsdStageRefPtr &stage, OutlinerCompositionCost &compositionCost) {
+    // The costs computed before a resync are all fetched here, before the resynced subtrees are invalidated
+    std::vector<CompositionCostScan::Result> results;
+    if (compositionCost.scan.FetchResults(results)) {
+        for (const auto &result : results) {
+            compositionCost.costs[result.first] = result.second;
+            compositionCost.maxNodes = std::max(compositionCost.maxNodes, result.second.numNodes);
+        }
+        compositionCost.hotspotsAreValid = false;
+    }
+    if (!compositionCost.resyncedPaths.empty()) {
+        SdfPath::RemoveDescendentPaths(&compositionCost.resyncedPaths);
+        for (const auto &path : compositionCost.resyncedPaths) {
+            auto it = compositionCost.costs.find(path);
+            if (it != compositionCost.costs.end()) {
+                compositionCost.costs.erase(it);
+            }
+            compositionCost.pendingRoots.push_back(path);
+        }
+        compositionCost.resyncedPaths.clear();
+        compositionCost.hotspotsAreValid = false;
+    }
+    if (compositionCost.scan.IsRunning() || IsStageEditLocked()) {
+        return;
+    }
+    // The subtrees not finished by an interrupted scan are scanned again with the resynced ones
+    SdfPathVector roots = compositionCost.scan.GetUnfinishedRoots();
+    roots.insert(roots.end(), compositionCost.pendingRoots.begin(), compositionCost.pendingRoots.end());
+    compositionCost.pendingRoots.clear();
+    if (roots.empty()) {
+        return;
+    }
+    SdfPath::RemoveDescendentPaths(&roots);
+    // The root prims are scanned in parallel
+    if (roots.front().IsAbsoluteRootPath()) {
+        roots.clear();
+        compositionCost.costs[SdfPath::AbsoluteRootPath()] = ComputePrimCompositionCost(stage->GetPseudoRoot());
+        for (const auto &child : stage->GetPseudoRoot().GetAllChildren()) {
+            roots.push_back(child.GetPath());
+        }
+    }
+    compositionCost.scan.Start(stage, std::move(roots));
+}
+
+static bool IsCostlier(const CompositionCostScan::Result &a, const CompositionCostScan::Result &b, int column) {
+    switch (column) {
+    case 0:
+        return a.first < b.first;
+    case 2:
+        return a.second.numLayers < b.second.numLayers;
+    case 3:
+        return a.second.numSpecs < b.second.numSpecs;
+    default:
+        return a.second.numNodes < b.second.numNodes;
+    }
+}
+
+/// Keep the first prims in the sort order of the hotspots table, the whole stage is not sorted
+static void UpdateHotspots(OutlinerCompositionCost &compositionCost) {
+    constexpr size_t maxHotspots = 100;
+    const int column = compositionCost.sortColumn;
+    const bool ascending = compositionCost.sortAscending;
+    // Heap whose top is the last hotspot in the sort order
+    const auto comesFirst = [&](const CompositionCostScan::Result &a, const CompositionCostScan::Result &b) {
+        return ascending ? IsCostlier(b, a, column) : IsCostlier(a, b, column);
+    };
+    const auto heapOrder = [&](const CompositionCostScan::Result &a, const CompositionCostScan::Result &b) {
+        return comesFirst(b, a);
+    };
+    std::vector<CompositionCostScan::Result> &hotspots = compositionCost.hotspots;
+    hotspots.clear();
+    compositionCost.maxNodes = 1;
+    for (const auto &cost : compositionCost.costs) {
+        if (!cost.second.isValid) {
+            continue;
+        }
+        compositionCost.maxNodes = std::max(compositionCost.maxNodes, cost.second.numNodes);
+        if (hotspots.size() < maxHotspots) {
+            hotspots.emplace_back(cost.first, cost.second);
+            std::push_heap(hotspots.begin(), hotspots.end(), heapOrder);
+        } else if (comesFirst(CompositionCostScan::Result(cost.first, cost.second), hotspots.front())) {
+            std::pop_heap(hotspots.begin(), hotspots.end(), heapOrder);
+            hotspots.back() = CompositionCostScan::Result(cost.first, cost.second);
+            std::push_heap(hotspots.begin(), hotspots.end(), heapOrder);
+        }
+    }
+    std::sort_heap(hotspots.begin(), hotspots.end(), heapOrder);
+    compositionCost.hotspotsAreValid = true;
+    compositionCost.lastHotspotsUpdate = ImGui::GetTime();
+}
+
+/// Color of the cost in the heatmap, from green to red on a log scale of the number of nodes
+static ImVec4 GetCompositionCostColor(const PrimCompositionCost &cost, uint32_t maxNodes) {
+    const float heat = maxNodes > 1 ? std::log(static_cast<float>(cost.numNodes)) / std::log(static_cast<float>(maxNodes)) : 0.f;
+    return ImVec4(0.3f + 0.6f * heat, 0.8f - 0.6f * heat, 0.3f - 0.1f * heat, 1.f);
+}
+
+static void DrawCompositionCostTooltip(const PrimCompositionCost &cost) {
+    if (ImGui::IsItemHovered()) {
+        ImGui::BeginTooltip();
+        ImGui::Text("%u nodes, %u opinions in %u layers", cost.numNodes, cost.numSpecs, cost.numLayers);
+        ImGui::Text("Arcs: %s", GetArcTypesString(cost.arcTypes).c_str());
+        if (cost.strongestLayer) {
+            ImGui::Text("Strongest layer: %s", cost.strongestLayer->GetIdentifier().c_str());
+        }
+        ImGui::EndTooltip();
     }
 }
 
-/// This function should be called only when the Selection has changed
-/// It modifies the internal imgui tree graph state.
-/// It uses a hash that must be the same as the node, at the moment the label is the name of the prim
-/// which should be the same as the name on the selected paths
-static void OpenSelectedPaths(Selection &selectedPaths) {
-    ImGuiContext &g = *GImGui;
-    ImGuiWindow *window = g.CurrentWindow;
-    ImGuiStorage *storage = window->DC.StateStorage;
-    for (const auto &path : GetSelectedPaths(selectedPaths)) {
-        for (const auto &element : path.GetPrefixes()) {
-            ImGuiID id = window->GetID(element.GetElementString().c_str());
-            storage->SetInt(id, true);
-            window->IDStack.push_back(id);
+/// Sortable table of the prims with the costliest composition
+static void DrawCompositionHotspots(OutlinerCompositionCost &compositionCost, Selection &selectedPaths) {
+    constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_Sortable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY |
+                                           ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_Resizable;
+    if (!ImGui::BeginTable("##CompositionHotspots", 5, tableFlags, ImVec2(0, ImGui::GetFontSize() * 12))) {
+        return;
+    }
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Prim", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Nodes", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("Layers", ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("Opinions", ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("Arcs", ImGuiTableColumnFlags_NoSort);
+    ImGui::TableHeadersRow();
+    if (ImGuiTableSortSpecs *sortSpecs = ImGui::TableGetSortSpecs()) {
+        if (sortSpecs->SpecsDirty && sortSpecs->SpecsCount > 0) {
+            compositionCost.sortColumn = sortSpecs->Specs[0].ColumnIndex;
+            compositionCost.sortAscending = sortSpecs->Specs[0].SortDirection == ImGuiSortDirection_Ascending;
+            compositionCost.hotspotsAreValid = false;
         }
-        for (int i = 0; i < path.GetPrefixes().size(); ++i) {
-            window->IDStack.pop_back();
+        sortSpecs->SpecsDirty = false;
+    }
+    // The hotspots are updated a few times per second while the scan is running
+    if (!compositionCost.hotspotsAreValid &&
+        (!compositionCost.scan.IsRunning() || ImGui::GetTime() - compositionCost.lastHotspotsUpdate > 0.5)) {
+        UpdateHotspots(compositionCost);
+    }
+    for (const auto &hotspot : compositionCost.hotspots) {
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        if (ImGui::Selectable(hotspot.first.GetText(), IsSelected(selectedPaths, hotspot.first),
+                              ImGuiSelectableFlags_SpanAllColumns)) {
+            SetSelected(selectedPaths, hotspot.first);
         }
+        DrawCompositionCostTooltip(hotspot.second);
+        ImGui::TableSetColumnIndex(1);
+        ImGui::TextColored(GetCompositionCostColor(hotspot.second, compositionCost.maxNodes), "%u", hotspot.second.numNodes);
+        ImGui::TableSetColumnIndex(2);
+        ImGui::Text("%u", hotspot.second.numLayers);
+        ImGui::TableSetColumnIndex(3);
+        ImGui::Text("%u", hotspot.second.numSpecs);
+        ImGui::TableSetColumnIndex(4);
+        ImGui::Text("%s", GetArcTypesString(hotspot.second.arcTypes).c_str());
     }
+    ImGui::EndTable();
+}
+
+/// Rows added at most by the unfold to depth and by the reveal of the selection
+static constexpr size_t UnfoldRowBudget = 100000;
+
+/// Unfolding more prims than this asks for a confirmation
+static constexpr size_t UnfoldAllWarningThreshold = 10000;
+
+/// The counts are only known when the descendant counts are computed, they are empty otherwise
+struct UnfoldAllModalDialog : public ModalDialog {
+    UnfoldAllModalDialog(StageOutlinerState &state, const UsdPrim &prim, const PrimCounts &counts)
+        : _state(state), _prim(prim), _counts(counts){};
+    ~UnfoldAllModalDialog() override {}
+
+    void Draw() override {
+        if (_counts.total) {
+            ImGui::Text("%s has %zu descendants, %zu gprims.", _prim.GetPath().GetText(), _counts.total, _counts.gprims);
+        } else {
+            ImGui::Text("%s has more than %zu descendants.", _prim.GetPath().GetText(), UnfoldAllWarningThreshold);
+        }
+        ImGui::Text("Unfolding all of them might take a while.");
+        DrawOkCancelModal([&]() {
+            if (_prim) {
+                _state.UnfoldSubtree(_prim);
+            }
+        });
+    }
+    const char *DialogId() const override { return "Unfold all"; }
+
+    StageOutlinerState &_state;
+    UsdPrim _prim;
+    PrimCounts _counts;
+};
+
+static void DrawUnfoldAllMenuItem(const UsdPrim &prim, StageOutlinerState &state) {
+    if (ImGui::MenuItem("Unfold all")) {
+        // Without the counts, the subtree is traversed until it has more prims than the threshold
+        PrimCounts counts;
+        const bool isBig = state.GetDescendantCounts(prim.GetPath(), counts)
+                               ? counts.total > UnfoldAllWarningThreshold
+                               : CountDescendants(prim, UnfoldAllWarningThreshold + 1) > UnfoldAllWarningThreshold;
+        if (isBig) {
+            DrawModalDialog<UnfoldAllModalDialog>(state, prim, counts);
+        } else {
+            state.UnfoldSubtree(prim);
+        }
+    }
+}
+
+static void DrawUnfoldToDepthMenu(const UsdPrim &prim, StageOutlinerState &state) {
+    if (ImGui::BeginMenu("Unfold to depth")) {
+        for (int depth = 1; depth <= 5; ++depth) {
+            if (ImGui::MenuItem(std::to_string(depth).c_str())) {
+                state.UnfoldToDepth(prim, depth, UnfoldRowBudget);
+            }
+        }
+        ImGui::EndMenu();
+    }
+}
+
+static void DrawDescendantCounts(const SdfPath &path, StageOutlinerState &state) {
+    PrimCounts counts;
+    if (!state.AreDescendantsCounted()) {
+        ImGui::TextDisabled("...");
+        return;
+    }
+    if (!state.GetDescendantCounts(path, counts) || counts.total == 0) {
+        return;
+    }
+    if (counts.total > UnfoldAllWarningThreshold) {
+        ImGui::TextColored(ImVec4(1.0, 0.6, 0.3, 1.0), "%zu", counts.total);
+    } else {
+        ImGui::Text("%zu", counts.total);
+    }
+    if (ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("%zu descendants: %zu loaded, %zu active, %zu gprims", counts.total, counts.loaded, counts.active,
+                          counts.gprims);
+    }
+}
+
+static void DrawOutlinerRow(const OutlinerRow &row, const char *rootLabel, StageOutlinerState &state,
+                            Selection &selectedPaths, UsdTimeCode currentTime, bool filtered) {
+    const PrimDisplayInfo &info = state.GetDisplayInfo(row.prim, currentTime);
+    const SdfPath &path = row.prim.GetPath();
+    const bool isRoot = row.prim.IsPseudoRoot();
+    // The filtered rows are all unfolded
+    const bool unfolded = filtered ? row.hasChildren : state.IsUnfolded(path);
+    ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+    if (!row.hasChildren) {
+        flags |= ImGuiTreeNodeFlags_Leaf;
+    }
+    if (IsSelected(selectedPaths, path)) {
+        flags |= ImGuiTreeNodeFlags_Selected;
+    }
+    if (!info.active) {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(PrimInactiveColor));
+    }
+
+    // The rows are not in a tree, the depth is drawn with an indentation
+    const float indent = row.depth * ImGui::GetStyle().IndentSpacing;
+    if (indent > 0.f) {
+        ImGui::Indent(indent);
+    }
+    ImGui::SetNextItemOpen(unfolded);
+    const void *nodeId = reinterpret_cast<void *>(SdfPath::Hash{}(path));
+    if (row.prim.IsPrototype()) {
+        ImGui::TreeNodeEx(nodeId, flags, "%s (%zu instances)", row.prim.GetName().GetText(), row.numInstances);
+    } else {
+        ImGui::TreeNodeEx(nodeId, flags, "%s",
+                          isRoot ? rootLabel : (row.showPath ? path.GetText() : row.prim.GetName().GetText()));
+    }
+    if (ImGui::IsItemToggledOpen()) {
+        if (!filtered) {
+            state.SetUnfolded(path, !unfolded);
+        }
+    } else if (ImGui::IsItemClicked() && !isRoot) {
+        SetSelected(selectedPaths, path);
+    }
+    // The root menu only unfolds and expands the population mask
+    if ((!isRoot || row.hasChildren || !row.prim.GetStage()->GetPopulationMask().IncludesSubtree(path)) &&
+        ImGui::BeginPopupContextItem()) {
+        if (!isRoot) {
+            DrawUsdPrimEditMenuItems(row.prim);
+        }
+        if (row.hasChildren && !filtered) {
+            if (!isRoot) {
+                DrawUnfoldAllMenuItem(row.prim, state);
+            }
+            DrawUnfoldToDepthMenu(row.prim, state);
+        }
+        DrawPopulationMaskMenuItems(row.prim);
+        ImGui::EndPopup();
+    }
+    // Mark the folded nodes hiding selected prims
+    if (!unfolded && HasSelectedDescendant(selectedPaths, path)) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(PrimHasSelectedDescendantColor), ICON_FA_DOT_CIRCLE);
+    }
+    if (indent > 0.f) {
+        ImGui::Unindent(indent);
+    }
+
+    ImGui::NextColumn();
+    if (info.visibilityAttr) {
+        // The prims hidden by an ancestor are greyed out
+        if (info.inheritedInvisible) {
+            ImGui::TextDisabled("%s", ICON_FA_EYE_SLASH);
+        } else {
+            ImGui::Text("%s", info.invisible ? ICON_FA_EYE_SLASH : ICON_FA_EYE);
+        }
+        ImGui::SameLine();
+    }
+    if (info.kind.IsEmpty()) {
+        ImGui::Text("%s", info.typeName.GetText());
+    } else {
+        ImGui::Text("%s (%s)", info.typeName.GetText(), info.kind.GetText());
+    }
+    if (info.hasPayload) {
+        ImGui::SameLine();
+        ImGui::Text("%s", row.prim.IsLoaded() ? ICON_FA_BOX : ICON_FA_ARCHIVE);
+    }
+    if (info.isTimeVarying) {
+        ImGui::SameLine();
+        ImGui::Text("%s", ICON_FA_STOPWATCH);
+    }
+
+    if (!info.active) {
+        ImGui::PopStyleColor();
+    }
+
+    if (state.compositionCost.isShown) {
+        ImGui::NextColumn();
+        const auto cost = state.compositionCost.costs.find(path);
+        if (cost != state.compositionCost.costs.end() && cost->second.isValid) {
+            ImGui::TextColored(GetCompositionCostColor(cost->second, state.compositionCost.maxNodes), "%u nodes %u layers",
+                               cost->second.numNodes, cost->second.numLayers);
+            DrawCompositionCostTooltip(cost->second);
+        } else {
+            ImGui::TextDisabled("...");
+        }
+    }
+
+    if (state.showDescendantCounts) {
+        ImGui::NextColumn();
+        DrawDescendantCounts(path, state);
+    }
+
+    ImGui::NextColumn(); // Back to the first column
 }
 
 /// Draw the hierarchy of the stage
-void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths) {
+void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths, UsdTimeCode currentTime) {
     if (!stage)
         return;
-    constexpr unsigned int textBufferSize = 512;
-    static char buf[textBufferSize];
-    bool addprimclicked = false;
-    auto rootPrim = stage->GetPseudoRoot();
-    auto layer = stage->GetSessionLayer();
-
-    ImGui::Columns(2); // Prim name | Type (Xform)
-    ImGuiTreeNodeFlags nodeflags = ImGuiTreeNodeFlags_OpenOnArrow;
-    auto unfolded = ImGui::TreeNodeEx(stage->GetRootLayer()->GetDisplayName().c_str(), nodeflags);
+    StageOutlinerState &state = GetStageOutlinerState(stage);
 
     // Unfold the selected paths.
     // TODO: This might be a behavior we don't want in some situations, so add a way to toggle it
+    // Only the newly selected paths are unfolded when the selection changes incrementally
+    // A different selection means the stage has changed, its unfolded nodes are already in its state
     static SelectionHash lastSelectionHash = 0;
-    if (UpdateSelectionHash(selectedPaths, lastSelectionHash)) { // We could use the imgui id as well instead of a static ??
-        OpenSelectedPaths(selectedPaths);
-        // TODO HighlightSelectedPaths();
+    static uint64_t lastSelectionGeneration = 0;
+    static const Selection *lastSelection = nullptr;
+    if (&selectedPaths != lastSelection) {
+        lastSelection = &selectedPaths;
+        lastSelectionHash = selectedPaths.GetHash();
+        lastSelectionGeneration = GetSelectionGeneration(selectedPaths);
+    } else if (GetSelectionGeneration(selectedPaths) != lastSelectionGeneration) {
+        SdfPathVector added;
+        SdfPathVector removed;
+        const bool incremental = GetSelectionChanges(selectedPaths, lastSelectionGeneration, added, removed);
+        if (UpdateSelectionHash(selectedPaths, lastSelectionHash)) {
+            state.RevealPaths(incremental ? added : GetSelectedPaths(selectedPaths), UnfoldRowBudget);
+            // TODO HighlightSelectedPaths();
+        }
+        lastSelectionGeneration = GetSelectionGeneration(selectedPaths);
     }
 
-    ImGui::NextColumn();
-    ImGui::Text("");
-    ImGui::NextColumn(); // Back to the first column
-    if (unfolded) {
-        for (const auto &child : rootPrim.GetAllChildren()) {
-            DrawPrimTreeNode(child, selectedPaths);
+    state.UpdateRows();
+    DrawOutlinerFilter(stage, state.filter);
+    ImGui::SameLine();
+    bool showPrototypes = state.IsShowingPrototypes();
+    if (ImGui::Checkbox("Prototypes", &showPrototypes)) {
+        state.SetShowPrototypes(showPrototypes);
+        state.UpdateRows();
+    }
+    ImGui::SameLine();
+    OutlinerCompositionCost &compositionCost = state.compositionCost;
+    if (ImGui::Checkbox("Composition cost", &compositionCost.isShown)) {
+        // The costs are only kept while they are shown
+        compositionCost.scan.Cancel();
+        compositionCost.costs.clear();
+        compositionCost.hotspots.clear();
+        compositionCost.resyncedPaths.clear();
+        compositionCost.pendingRoots.clear();
+        compositionCost.maxNodes = 1;
+        if (compositionCost.isShown) {
+            compositionCost.pendingRoots.push_back(SdfPath::AbsoluteRootPath());
+        }
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Descendants", &state.showDescendantCounts);
+    if (compositionCost.isShown) {
+        UpdateCompositionCost(stage, compositionCost);
+        if (ImGui::CollapsingHeader("Composition hotspots")) {
+            DrawCompositionHotspots(compositionCost, selectedPaths);
+        }
+    }
+    if (showPrototypes) {
+        const auto &summary = state.GetPrototypesSummary();
+        ImGui::Text("%zu prototypes, %zu instances: %zu prims composed instead of %zu", summary.numPrototypes,
+                    summary.numInstances, summary.numPrototypePrims, summary.numInstancedPrims);
+    }
+    const bool filtered = state.filter.query[0] && state.filter.isValid;
+    const std::vector<OutlinerRow> &rows = filtered ? state.filter.rows : state.GetRows();
+
+    // Each stage is drawn in its own child window, so the scroll position of the other stages is kept by imgui
+    // when switching stage. The stages opened on the same root layer have their own child window
+    ImGui::PushID(get_pointer(stage));
+    ImGui::BeginChild("##StageOutlinerRows");
+    // Prim name | Type (Xform) | Composition cost | Descendants
+    ImGui::Columns(2 + (compositionCost.isShown ? 1 : 0) + (state.showDescendantCounts ? 1 : 0));
+    // Only the visible rows are drawn
+    const std::string rootLabel = stage->GetRootLayer()->GetDisplayName();
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(rows.size()));
+    while (clipper.Step()) {
+        for (int rowIndex = clipper.DisplayStart; rowIndex < clipper.DisplayEnd; ++rowIndex) {
+            DrawOutlinerRow(rows[rowIndex], rootLabel.c_str(), state, selectedPaths, currentTime, filtered);
         }
-        ImGui::TreePop();
     }
     ImGui::Columns(1);
+    ImGui::EndChild();
+    ImGui::PopID();
 }
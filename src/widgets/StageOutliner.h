@@ -4,5 +4,5 @@
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
-// TODO: selected could be multiple Path, we should pass a HdSelection instead
-void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths);
+/// Draw the hierarchy of the stage, the visibility is computed at currentTime
+void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths, UsdTimeCode currentTime);